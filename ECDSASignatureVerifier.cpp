@@ -0,0 +1,90 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ECDSASignatureVerifier.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::ECDSASignatureVerifier";
+	const size_t	P256_KEY_BITS				= 256;
+	const size_t	SHA256_LENGTH				= 32;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		ECDSASignatureVerifier::ECDSASignatureVerifier()
+		{
+			mbedtls_pk_init(&_publicKey);
+		}
+
+		ECDSASignatureVerifier::~ECDSASignatureVerifier()
+		{
+			mbedtls_pk_free(&_publicKey);
+		}
+
+		bool ECDSASignatureVerifier::setPublicKey(const unsigned char *key, size_t length)
+		{
+			mbedtls_pk_free(&_publicKey);
+			mbedtls_pk_init(&_publicKey);
+			_keySet = false;
+
+			int result = mbedtls_pk_parse_public_key(&_publicKey, key, length);
+
+			if ( result != 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not parse public key: -0x%04x", -result);
+				return false;
+			}
+
+			if ( mbedtls_pk_get_type(&_publicKey) != MBEDTLS_PK_ECKEY || mbedtls_pk_get_bitlen(&_publicKey) != P256_KEY_BITS )
+			{
+				ESP_LOGE(LOG_TAG, "public key is not a P-256 key");
+				mbedtls_pk_free(&_publicKey);
+				mbedtls_pk_init(&_publicKey);
+				return false;
+			}
+
+			_keySet = true;
+			return true;
+		}
+
+		int ECDSASignatureVerifier::verify(const unsigned char *hash, size_t hashLength, const unsigned char *signature, size_t signatureLength)
+		{
+			if ( _keySet == false )
+			{
+				ESP_LOGE(LOG_TAG, "no public key set!");
+				return -1;
+			}
+
+			if ( hashLength != SHA256_LENGTH )
+			{
+				ESP_LOGE(LOG_TAG, "expected a SHA-256 hash, got %zu bytes", hashLength);
+				return -1;
+			}
+
+			return mbedtls_pk_verify(&_publicKey, MBEDTLS_MD_SHA256, hash, hashLength, signature, signatureLength);
+		}
+
+	}
+}
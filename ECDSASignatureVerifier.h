@@ -0,0 +1,69 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECDSASIGNATUREVERIFIER_H
+#define ECDSASIGNATUREVERIFIER_H
+
+#include "SignatureVerifier.h"
+
+extern "C"
+{
+	#include <mbedtls/pk.h>
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The ECDSASignatureVerifier class checks ECDSA P-256 signatures with mbedTLS.
+         *
+         * Install it for SignatureScheme::ECDSA_P256 together with a SHA-256 HashAlgorithm. The signatures are
+         * DER encoded as written by `openssl dgst -sha256 -sign` and `fota_package.py --scheme ecdsa-p256`.
+         * The signatures and keys are smaller than RSA-2048 ones, but verifying is slower, see test/SignatureBenchmark.cpp.
+         */
+		class ECDSASignatureVerifier : public Crypto::SignatureVerifier
+		{
+			public:
+
+									ECDSASignatureVerifier();
+									~ECDSASignatureVerifier() override;
+
+                /**
+                 * @brief           Set the public key of the signer
+                 *
+                 * @param key       PEM (including the terminating null byte) or DER encoded public key
+                 * @param length    length of the key in bytes
+                 *
+                 * @return          \c true if the key is a 256 bit EC key, otherwise \c false
+                 */
+				bool				setPublicKey(const unsigned char* key, size_t length);
+
+				int					verify(const unsigned char* hash, size_t hashLength, const unsigned char* signature, size_t signatureLength) override;
+
+			private:
+
+									ECDSASignatureVerifier(const ECDSASignatureVerifier&) = delete;
+				ECDSASignatureVerifier&	operator=(const ECDSASignatureVerifier&) = delete;
+
+				mbedtls_pk_context	_publicKey;
+				bool				_keySet = { false };
+		};
+	}
+}
+
+#endif // ECDSASIGNATUREVERIFIER_H
@@ -0,0 +1,255 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FileFirmwareSource.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_timer.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#if defined(__linux__)
+	#include <sys/mman.h>
+#endif
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::FileFirmwareSource";
+	const size_t	FILE_READ_SIZE				= 32768;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		FileFirmwareSource::FileFirmwareSource()
+		{
+
+		}
+
+		FileFirmwareSource::~FileFirmwareSource()
+		{
+			close();
+		}
+
+		void FileFirmwareSource::setPath(const std::string &path)
+		{
+			close();
+			_path = path;
+			_fd = -1;
+			_length = 0;
+			_givenLength = 0;
+			_fdStart = 0;
+			_idleEndUs = 0;
+		}
+
+		void FileFirmwareSource::setFileDescriptor(int fd, int length, uint32_t idleEndMs)
+		{
+			close();
+			_path.clear();
+			_fd = fd;
+			_length = length;
+			_givenLength = length;
+			// the image starts where the caller left the descriptor, a pipe or UART reports -1
+			_fdStart = lseek(fd, 0, SEEK_CUR);
+			_idleEndUs = static_cast<int64_t>(idleEndMs) * 1000;
+		}
+
+		bool FileFirmwareSource::open(size_t offset)
+		{
+			if ( ! _path.empty() )
+			{
+				_fd = ::open(_path.c_str(), O_RDONLY);
+
+				if ( _fd < 0 )
+				{
+					ESP_LOGE(LOG_TAG, "could not open %s: %d", _path.c_str(), errno);
+					return false;
+				}
+
+				_ownsFd = true;
+			}
+			else if ( _fd < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "no file or file descriptor set!");
+				return false;
+			}
+
+			struct stat fileStat;
+
+			if ( fstat(_fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && _fdStart <= fileStat.st_size )
+			{
+				int available = fileStat.st_size - _fdStart;
+
+				// a length passed by the caller wins, it may end the image before the end of the file
+				_length = _givenLength > 0 ? _givenLength : available;
+
+#if defined(__linux__)
+				// touching a mapping beyond the end of the file faults, such an image is read instead
+				if ( _length <= available )
+				{
+					off_t pageStart = _fdStart - _fdStart % sysconf(_SC_PAGESIZE);
+					size_t mappingSize = _length + (_fdStart - pageStart);
+					void* mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, _fd, pageStart);
+
+					if ( mapping != MAP_FAILED )
+					{
+						madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+						_mapping = mapping;
+						_mappingSize = mappingSize;
+						_mappedData = static_cast<const char*>(mapping) + (_fdStart - pageStart);
+					}
+				}
+#endif
+			}
+
+			if ( _length > 0 && offset > static_cast<size_t>(_length) )
+			{
+				ESP_LOGE(LOG_TAG, "offset %zu is beyond the image of %d bytes", offset, _length);
+				close();
+				return false;
+			}
+
+			if ( _mappedData == nullptr && (_fdStart >= 0 || offset > 0) )
+			{
+				off_t start = _fdStart + offset;
+
+				// a pipe or UART cannot skip what the sender has not sent again
+				if ( _fdStart < 0 || lseek(_fd, start, SEEK_SET) != start )
+				{
+					ESP_LOGE(LOG_TAG, "cannot start at offset %zu: %d", offset, errno);
+					close();
+					return false;
+				}
+			}
+
+			_offset = offset;
+			_position = offset;
+			_endOfStream = false;
+
+			return true;
+		}
+
+		void FileFirmwareSource::close()
+		{
+#if defined(__linux__)
+			if ( _mapping != nullptr )
+			{
+				munmap(_mapping, _mappingSize);
+			}
+#endif
+			_mapping = nullptr;
+			_mappingSize = 0;
+			_mappedData = nullptr;
+
+			if ( _ownsFd && _fd >= 0 )
+			{
+				::close(_fd);
+				_fd = -1;
+			}
+
+			_ownsFd = false;
+		}
+
+		int FileFirmwareSource::contentLength() const
+		{
+			return _length > 0 ? _length - static_cast<int>(_offset) : _length;
+		}
+
+		int FileFirmwareSource::read(void *buffer, size_t size)
+		{
+			size = clampToRemaining(size);
+
+			if ( size == 0 )
+			{
+				_endOfStream = true;
+				return 0;
+			}
+
+			ssize_t result = ::read(_fd, buffer, size);
+
+			if ( result < 0 )
+			{
+				// non blocking streams just have no data at the moment
+				return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+			}
+
+			if ( result == 0 )
+			{
+				_endOfStream = true;
+			}
+			else
+			{
+				_lastDataTimestamp = esp_timer_get_time();
+			}
+
+			_position += result;
+			return result;
+		}
+
+		bool FileFirmwareSource::isComplete()
+		{
+			if ( _endOfStream || (_length > 0 && _position >= _length) )
+			{
+				return true;
+			}
+
+			// a stream without an end of file is over once the sender went quiet
+			return _length <= 0 && _idleEndUs > 0 && _position > static_cast<int>(_offset) && esp_timer_get_time() - _lastDataTimestamp >= _idleEndUs;
+		}
+
+		size_t FileFirmwareSource::preferredReadSize() const
+		{
+			return FILE_READ_SIZE;
+		}
+
+		bool FileFirmwareSource::supportsDirectRead() const
+		{
+			return _mappedData != nullptr;
+		}
+
+		int FileFirmwareSource::readDirect(const void **data, size_t size)
+		{
+			if ( _mappedData == nullptr )
+			{
+				return -1;
+			}
+
+			size = clampToRemaining(size);
+
+			*data = _mappedData + _position;
+			_position += size;
+
+			return size;
+		}
+
+		size_t FileFirmwareSource::clampToRemaining(size_t size) const
+		{
+			if ( _length > 0 && size > static_cast<size_t>(_length - _position) )
+			{
+				return _length - _position;
+			}
+
+			return size;
+		}
+
+	}
+}
@@ -0,0 +1,102 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEFIRMWARESOURCE_H
+#define FILEFIRMWARESOURCE_H
+
+#include "IFirmwareSource.h"
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The FileFirmwareSource class reads a firmware image from a file or stream, e.g. an SD card,
+         *        a mounted filesystem or a UART / USB device opened via the VFS.
+         *
+         * Files are read in large chunks. On a Linux host build regular files are mapped into memory and
+         * handed to the writer without copying.
+         */
+		class FileFirmwareSource : public IFirmwareSource
+		{
+			public:
+
+									FileFirmwareSource();
+									~FileFirmwareSource() override;
+
+                /**
+                 * @brief           Read the firmware from a file, opened by the next open()
+                 * @param path      path of the firmware image
+                 */
+				void				setPath(const std::string& path);
+
+                /**
+                 * @brief           Read the firmware from an already opened file descriptor, e.g. a serial stream
+                 *
+                 * The image starts at the current position of the descriptor, e.g. behind a header the caller already
+                 * read. The descriptor is not closed by the source. Opening at an offset requires a seekable descriptor.
+                 * Without a length the image only ends when a read reports the end of the file, e.g. when the sender
+                 * closes a pipe or socket. A UART never does, so either pass the length or let the image end once the
+                 * stream was idle for \c idleEndMs after the first data.
+                 * The idle time has to stay below the stall timeout of the transfer (30 s). An image cut short this
+                 * way is rejected by the signature check.
+                 *
+                 * @param fd        the file descriptor to read from
+                 * @param length    size of the firmware image, \c 0 for the rest of a regular file or if unknown
+                 * @param idleEndMs end the image of unknown length after this idle time, \c 0 to wait for the end of the file
+                 */
+				void				setFileDescriptor(int fd, int length = 0, uint32_t idleEndMs = 0);
+
+				bool				open(size_t offset) override;
+				void				close() override;
+				int					contentLength() const override;
+				int					read(void* buffer, size_t size) override;
+				bool				isComplete() override;
+				size_t				preferredReadSize() const override;
+				bool				supportsDirectRead() const override;
+				int					readDirect(const void** data, size_t size) override;
+
+			private:
+
+                /**
+                 * @brief           Limit a read to the remaining image if its length is known
+                 */
+				size_t				clampToRemaining(size_t size) const;
+
+				std::string			_path;
+				int					_fd = { -1 };
+				bool				_ownsFd = { false };
+				int					_length = { 0 };
+				int					_givenLength = { 0 };		///< length passed with the file descriptor
+				off_t				_fdStart = { 0 };			///< file offset of the image, \c -1 if the descriptor cannot seek
+				size_t				_offset = { 0 };
+				int					_position = { 0 };			///< image offset of the next read
+				bool				_endOfStream = { false };
+				int64_t				_idleEndUs = { 0 };
+				int64_t				_lastDataTimestamp = { 0 };
+				const char*			_mappedData = { nullptr };
+				void*				_mapping = { nullptr };		///< page aligned start of the mapping
+				size_t				_mappingSize = { 0 };
+		};
+	}
+}
+
+#endif // FILEFIRMWARESOURCE_H
@@ -0,0 +1,310 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FirmwareImageCache.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_ota_ops.h>
+	#include <esp_rom_crc.h>
+	#include <stddef.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::FirmwareImageCache";
+	const uint32_t	SLOT_MAGIC					= 0x49444643;	// "IDFC"
+	const uint32_t	SLOT_VERSION				= 1;
+	const uint32_t	FLAG_VERIFIED				= 0x01;
+	const size_t	SECTOR_SIZE					= SPI_FLASH_SEC_SIZE;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		FirmwareImageCache::FirmwareImageCache()
+		{
+
+		}
+
+		bool FirmwareImageCache::begin(const char *partitionLabel, uint8_t imageCount)
+		{
+			_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+
+			if ( _partition == nullptr || imageCount == 0 || imageCount == UINT8_MAX )
+			{
+				ESP_LOGE(LOG_TAG, "image cache partition %s not found", partitionLabel);
+				_partition = nullptr;
+				return false;
+			}
+
+			_imageCount = imageCount;
+			_slotCount = imageCount + 1;
+			_slotSize = (_partition->size / _slotCount) / SECTOR_SIZE * SECTOR_SIZE;
+
+			if ( _slotSize <= SECTOR_SIZE )
+			{
+				ESP_LOGE(LOG_TAG, "image cache partition %s too small for %u slots", partitionLabel, _slotCount);
+				_partition = nullptr;
+				return false;
+			}
+
+			return true;
+		}
+
+		bool FirmwareImageCache::getEntryInfo(Entry entry, EntryInfo *info) const
+		{
+			SlotHeader header;
+
+			if ( findSlot(entry, &header) < 0 )
+			{
+				return false;
+			}
+
+			info->imageSize = header.imageSize;
+			info->imageCRC = header.imageCRC;
+			info->sequence = header.sequence;
+			info->verified = (header.flags & FLAG_VERIFIED) != 0;
+
+			return true;
+		}
+
+		bool FirmwareImageCache::beginWrite(size_t imageSize)
+		{
+			if ( _partition == nullptr )
+			{
+				return false;
+			}
+
+			if ( imageSize != OTA_SIZE_UNKNOWN && imageSize > slotImageCapacity() )
+			{
+				ESP_LOGW(LOG_TAG, "image of %zu bytes does not fit into the cache", imageSize);
+				return false;
+			}
+
+			_writeSlot = -1;
+			int latestSlot = findSlot(Entry::Latest);
+			int previousSlot = findSlot(Entry::Previous);
+
+			// prefer an empty slot, otherwise replace the oldest one, which is the spare slot as there is one more than kept images
+			int writeSlot = -1;
+			uint32_t oldestSequence = UINT32_MAX;
+
+			for ( uint8_t slot = 0; slot < _slotCount; slot++ )
+			{
+				SlotHeader header;
+
+				if ( readHeader(slot, &header) == false )
+				{
+					writeSlot = slot;
+					break;
+				}
+
+				if ( header.sequence < oldestSequence )
+				{
+					oldestSequence = header.sequence;
+					writeSlot = slot;
+				}
+			}
+
+			if ( writeSlot < 0 || writeSlot == latestSlot || writeSlot == previousSlot )
+			{
+				return false;
+			}
+
+			if ( esp_partition_erase_range(_partition, slotOffset(writeSlot), SECTOR_SIZE) != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "could not invalidate cache slot %d", writeSlot);
+				return false;
+			}
+
+			_writeSlot = writeSlot;
+
+			_writtenBytes = 0;
+			_erasedBytes = 0;
+			_writeCRC = 0;
+
+			return true;
+		}
+
+		esp_err_t FirmwareImageCache::write(const void *data, size_t size)
+		{
+			if ( _writeSlot < 0 )
+			{
+				return ESP_ERR_INVALID_STATE;
+			}
+
+			if ( _writtenBytes + size > slotImageCapacity() )
+			{
+				return ESP_ERR_INVALID_SIZE;
+			}
+
+			size_t imageOffset = slotOffset(_writeSlot) + SECTOR_SIZE;
+
+			while ( _writtenBytes + size > _erasedBytes )
+			{
+				esp_err_t result = esp_partition_erase_range(_partition, imageOffset + _erasedBytes, SECTOR_SIZE);
+
+				if ( result != ESP_OK )
+				{
+					return result;
+				}
+
+				_erasedBytes += SECTOR_SIZE;
+			}
+
+			esp_err_t result = esp_partition_write(_partition, imageOffset + _writtenBytes, data, size);
+
+			if ( result == ESP_OK )
+			{
+				_writeCRC = esp_rom_crc32_le(_writeCRC, static_cast<const uint8_t*>(data), size);
+				_writtenBytes += size;
+			}
+
+			return result;
+		}
+
+		bool FirmwareImageCache::commit(bool verified)
+		{
+			if ( _writeSlot < 0 )
+			{
+				return false;
+			}
+
+			SlotHeader latest;
+			uint32_t sequence = findSlot(Entry::Latest, &latest) >= 0 ? latest.sequence + 1 : 1;
+
+			SlotHeader header;
+			header.magic = SLOT_MAGIC;
+			header.version = SLOT_VERSION;
+			header.sequence = sequence;
+			header.imageSize = _writtenBytes;
+			header.imageCRC = _writeCRC;
+			header.flags = verified ? FLAG_VERIFIED : 0;
+			header.headerCRC = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&header), offsetof(SlotHeader, headerCRC));
+
+			esp_err_t result = esp_partition_write(_partition, slotOffset(_writeSlot), &header, sizeof(header));
+
+			if ( result != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "could not write cache header: %s", esp_err_to_name(result));
+			}
+			else
+			{
+				ESP_LOGI(LOG_TAG, "cached %zu bytes in slot %d", _writtenBytes, _writeSlot);
+			}
+
+			_writeSlot = -1;
+			return result == ESP_OK;
+		}
+
+		void FirmwareImageCache::discard()
+		{
+			_writeSlot = -1;
+		}
+
+		esp_err_t FirmwareImageCache::read(Entry entry, size_t offset, void *buffer, size_t size) const
+		{
+			SlotHeader header;
+			int slot = findSlot(entry, &header);
+
+			if ( slot < 0 )
+			{
+				return ESP_ERR_NOT_FOUND;
+			}
+
+			if ( offset + size > header.imageSize )
+			{
+				return ESP_ERR_INVALID_SIZE;
+			}
+
+			return esp_partition_read(_partition, slotOffset(slot) + SECTOR_SIZE + offset, buffer, size);
+		}
+
+		bool FirmwareImageCache::readHeader(uint8_t slot, SlotHeader *header) const
+		{
+			if ( esp_partition_read(_partition, slotOffset(slot), header, sizeof(SlotHeader)) != ESP_OK )
+			{
+				return false;
+			}
+
+			return header->magic == SLOT_MAGIC && header->version == SLOT_VERSION
+					&& header->headerCRC == esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(header), offsetof(SlotHeader, headerCRC))
+					&& header->imageSize <= slotImageCapacity();
+		}
+
+		int FirmwareImageCache::findSlot(Entry entry, SlotHeader *header) const
+		{
+			if ( _partition == nullptr )
+			{
+				return -1;
+			}
+
+			int latestSlot = -1;
+			int previousSlot = -1;
+			SlotHeader latest = {};
+			SlotHeader previous = {};
+
+			for ( uint8_t slot = 0; slot < _slotCount; slot++ )
+			{
+				SlotHeader current;
+
+				// the slot being written is invalid until it is committed
+				if ( slot == _writeSlot || readHeader(slot, &current) == false )
+				{
+					continue;
+				}
+
+				if ( latestSlot < 0 || current.sequence > latest.sequence )
+				{
+					previousSlot = latestSlot;
+					previous = latest;
+					latestSlot = slot;
+					latest = current;
+				}
+				else if ( previousSlot < 0 || current.sequence > previous.sequence )
+				{
+					previousSlot = slot;
+					previous = current;
+				}
+			}
+
+			// with a single kept image the second one sits in the spare slot and goes with the next update
+			int slot = entry == Entry::Latest ? latestSlot : (_imageCount > 1 ? previousSlot : -1);
+
+			if ( slot >= 0 && header != nullptr )
+			{
+				*header = entry == Entry::Latest ? latest : previous;
+			}
+
+			return slot;
+		}
+
+		size_t FirmwareImageCache::slotImageCapacity() const
+		{
+			return _slotSize - SECTOR_SIZE;
+		}
+
+		size_t FirmwareImageCache::slotOffset(uint8_t slot) const
+		{
+			return slot * _slotSize;
+		}
+
+	}
+}
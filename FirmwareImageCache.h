@@ -0,0 +1,137 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIRMWAREIMAGECACHE_H
+#define FIRMWAREIMAGECACHE_H
+
+extern "C"
+{
+	#include "esp_partition.h"
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The FirmwareImageCache class keeps copies of installed firmware images in a spare data partition.
+         *
+         * The partition is split into slots, each holding one image behind a header sector. The header is written
+         * last, so an interrupted write never leaves a valid looking entry. One slot more than the number of kept
+         * images is used, a new image always goes to a slot that holds none of them. A failed or interrupted
+         * download therefore never costs the latest or, with the default of two images, the previous image that
+         * a rollback reinstalls.
+         */
+		class FirmwareImageCache
+		{
+			public:
+
+				enum class Entry
+				{
+					Latest,
+					Previous
+				};
+
+				struct EntryInfo
+				{
+					uint32_t	imageSize = { 0 };
+					uint32_t	imageCRC = { 0 };
+					uint32_t	sequence = { 0 };
+					bool		verified = { false };	///< the image passed the signature check when it was cached, informational only
+				};
+
+									FirmwareImageCache();
+
+                /**
+                 * @brief           Use a data partition as cache
+                 *
+                 * @param partitionLabel    label of the data partition
+                 * @param imageCount        number of images kept, the slot size is the partition size divided by
+                 *                          imageCount + 1
+                 *
+                 * @return          \c true if the partition was found, otherwise \c false
+                 */
+				bool				begin(const char* partitionLabel, uint8_t imageCount = 2);
+
+                /**
+                 * @brief           Get the information of a cached image
+                 * @return          \c true if the entry exists, otherwise \c false
+                 */
+				bool				getEntryInfo(Entry entry, EntryInfo* info) const;
+
+                /**
+                 * @brief           Start writing a new image into the spare slot, the kept images are never overwritten
+                 *
+                 * @param imageSize     size of the image, or OTA_SIZE_UNKNOWN
+                 *
+                 * @return          \c true if the image fits and the slot was invalidated, otherwise \c false
+                 */
+				bool				beginWrite(size_t imageSize);
+
+                /**
+                 * @brief           Append image data, sectors are erased as they are reached
+                 */
+				esp_err_t			write(const void* data, size_t size);
+
+                /**
+                 * @brief           Write the header and make the new image the latest entry
+                 * @param verified  if the image passed the signature check
+                 */
+				bool				commit(bool verified);
+
+                /**
+                 * @brief           Drop the image currently written, the slot stays invalid
+                 */
+				void				discard();
+
+                /**
+                 * @brief           Read from a cached image
+                 */
+				esp_err_t			read(Entry entry, size_t offset, void* buffer, size_t size) const;
+
+			private:
+
+				struct SlotHeader
+				{
+					uint32_t	magic;
+					uint32_t	version;
+					uint32_t	sequence;
+					uint32_t	imageSize;
+					uint32_t	imageCRC;
+					uint32_t	flags;
+					uint32_t	headerCRC;
+				};
+
+				bool				readHeader(uint8_t slot, SlotHeader* header) const;
+				int					findSlot(Entry entry, SlotHeader* header = nullptr) const;
+				size_t				slotImageCapacity() const;
+				size_t				slotOffset(uint8_t slot) const;
+
+				const esp_partition_t*	_partition = { nullptr };
+				uint8_t					_imageCount = { 0 };
+				uint8_t					_slotCount = { 0 };			///< _imageCount plus the spare slot
+				size_t					_slotSize = { 0 };
+
+				int						_writeSlot = { -1 };
+				size_t					_writtenBytes = { 0 };
+				size_t					_erasedBytes = { 0 };
+				uint32_t				_writeCRC = { 0 };
+		};
+	}
+}
+
+#endif // FIRMWAREIMAGECACHE_H
@@ -0,0 +1,336 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FirmwareSectorMap.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_rom_crc.h>
+	#include <esp_timer.h>
+	#include <nvs.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::FirmwareSectorMap";
+	const char*		NVS_NAMESPACE				= "idfix_fota";
+	const char*		NVS_KEY_INFO				= "map_info";
+	const char*		NVS_KEY_CRCS				= "map_crcs";
+	const uint32_t	MAP_MAGIC					= 0x49445343;	// "IDSC"
+	const size_t	SECTOR_SIZE					= SPI_FLASH_SEC_SIZE;
+	const size_t	SAVE_INTERVAL_SECTORS		= 4;			// bounds NVS wear and the data lost on power loss
+	const int64_t	SAVE_INTERVAL_US			= 2000000;		// bounds the data lost on slow links
+	const size_t	CHECK_BUFFER_SIZE			= 1024;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		FirmwareSectorMap::FirmwareSectorMap()
+		{
+
+		}
+
+		FirmwareSectorMap::~FirmwareSectorMap()
+		{
+			end();
+		}
+
+		void FirmwareSectorMap::setPersistent(bool persistent)
+		{
+			_persistent = persistent;
+		}
+
+		bool FirmwareSectorMap::isPersistent() const
+		{
+			return _persistent;
+		}
+
+		bool FirmwareSectorMap::begin(const esp_partition_t *partition, size_t imageSize)
+		{
+			if ( allocate(partition, imageSize) == false )
+			{
+				if ( _persistent )
+				{
+					erase();
+				}
+
+				return false;
+			}
+
+			// an empty map replaces the one of the previous update, so a power loss in the first sectors can resume
+			if ( _persistent )
+			{
+				save();
+			}
+
+			return true;
+		}
+
+		bool FirmwareSectorMap::load(const esp_partition_t *partition, size_t imageSize)
+		{
+			nvs_handle_t handle;
+
+			if ( nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK )
+			{
+				return false;
+			}
+
+			MapInfo info;
+			size_t length = sizeof(info);
+			bool loaded = false;
+
+			if ( nvs_get_blob(handle, NVS_KEY_INFO, &info, &length) == ESP_OK && length == sizeof(info)
+				 && info.magic == MAP_MAGIC && info.partitionAddress == partition->address && info.imageSize == static_cast<uint32_t>(imageSize)
+				 && allocate(partition, imageSize) && info.sectorCount <= _maxSectors )
+			{
+				// the CRCs are saved before the info, they may hold more sectors than the info counts
+				length = _maxSectors * sizeof(uint32_t);
+				loaded = info.sectorCount == 0 || nvs_get_blob(handle, NVS_KEY_CRCS, _sectorCRCs, &length) == ESP_OK;
+
+				if ( loaded )
+				{
+					_sectorCount = info.sectorCount;
+					_savedSectorCount = info.sectorCount;
+				}
+			}
+
+			nvs_close(handle);
+
+			if ( loaded == false )
+			{
+				end();
+			}
+
+			return loaded;
+		}
+
+		void FirmwareSectorMap::end()
+		{
+			delete [] _sectorCRCs;
+			_sectorCRCs = nullptr;
+			_partition = nullptr;
+			_maxSectors = 0;
+			_sectorCount = 0;
+			_savedSectorCount = 0;
+			_valid = false;
+		}
+
+		void FirmwareSectorMap::addData(const void *data, size_t size)
+		{
+			if ( _valid == false )
+			{
+				return;
+			}
+
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+			while ( size > 0 )
+			{
+				size_t chunkSize = SECTOR_SIZE - _currentLength < size ? SECTOR_SIZE - _currentLength : size;
+
+				_currentCRC = esp_rom_crc32_le(_currentCRC, bytes, chunkSize);
+				_currentLength += chunkSize;
+				bytes += chunkSize;
+				size -= chunkSize;
+
+				if ( _currentLength == SECTOR_SIZE )
+				{
+					if ( _sectorCount >= _maxSectors )
+					{
+						invalidate();
+						return;
+					}
+
+					_sectorCRCs[_sectorCount++] = _currentCRC;
+					_currentCRC = 0;
+					_currentLength = 0;
+				}
+			}
+
+			// the first sector at once, then by sector count or time, whichever comes first
+			if ( _persistent && _sectorCount > _savedSectorCount
+				 && (_savedSectorCount == 0 || _sectorCount >= _savedSectorCount + SAVE_INTERVAL_SECTORS
+					 || esp_timer_get_time() - _saveTimestamp >= SAVE_INTERVAL_US) )
+			{
+				save();
+			}
+		}
+
+		void FirmwareSectorMap::invalidate()
+		{
+			if ( _valid && _persistent )
+			{
+				erase();
+			}
+
+			_valid = false;
+		}
+
+		size_t FirmwareSectorMap::checkSectors(size_t firstSector, size_t count) const
+		{
+			if ( _valid == false || firstSector >= _sectorCount )
+			{
+				return 0;
+			}
+
+			if ( count > _sectorCount - firstSector )
+			{
+				count = _sectorCount - firstSector;
+			}
+
+			uint8_t *readBuffer = new uint8_t[CHECK_BUFFER_SIZE];
+
+			if ( readBuffer == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "could not allocate memory for checking sectors");
+				return 0;
+			}
+
+			size_t intactSectors = 0;
+
+			for ( ; intactSectors < count; intactSectors++ )
+			{
+				size_t sectorOffset = (firstSector + intactSectors) * SECTOR_SIZE;
+				uint32_t crc = 0;
+				bool readFailed = false;
+
+				for ( size_t offset = 0; offset < SECTOR_SIZE && readFailed == false; offset += CHECK_BUFFER_SIZE )
+				{
+					readFailed = esp_partition_read(_partition, sectorOffset + offset, readBuffer, CHECK_BUFFER_SIZE) != ESP_OK;
+					crc = esp_rom_crc32_le(crc, readBuffer, CHECK_BUFFER_SIZE);
+				}
+
+				if ( readFailed || crc != _sectorCRCs[firstSector + intactSectors] )
+				{
+					ESP_LOGW(LOG_TAG, "sector %zu does not match its CRC", firstSector + intactSectors);
+					break;
+				}
+			}
+
+			delete [] readBuffer;
+
+			return intactSectors;
+		}
+
+		void FirmwareSectorMap::truncate(size_t sectorCount)
+		{
+			if ( sectorCount < _sectorCount )
+			{
+				_sectorCount = sectorCount;
+			}
+
+			_currentCRC = 0;
+			_currentLength = 0;
+
+			if ( _persistent && _savedSectorCount != _sectorCount )
+			{
+				save();
+			}
+		}
+
+		size_t FirmwareSectorMap::getSectorCount() const
+		{
+			return _valid ? _sectorCount : 0;
+		}
+
+		bool FirmwareSectorMap::save()
+		{
+			if ( _valid == false )
+			{
+				return false;
+			}
+
+			nvs_handle_t handle;
+			esp_err_t result = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+			if ( result == ESP_OK )
+			{
+				MapInfo info = { MAP_MAGIC, _partition->address, _imageSize, static_cast<uint32_t>(_sectorCount) };
+
+				// the CRCs first, the info only covers sectors whose CRC is already stored
+				if ( _sectorCount > 0 )
+				{
+					result = nvs_set_blob(handle, NVS_KEY_CRCS, _sectorCRCs, _sectorCount * sizeof(uint32_t));
+				}
+
+				if ( result == ESP_OK )
+				{
+					result = nvs_set_blob(handle, NVS_KEY_INFO, &info, sizeof(info));
+				}
+
+				if ( result == ESP_OK )
+				{
+					result = nvs_commit(handle);
+				}
+
+				nvs_close(handle);
+			}
+
+			if ( result != ESP_OK )
+			{
+				ESP_LOGW(LOG_TAG, "could not save sector map: %s", esp_err_to_name(result));
+				return false;
+			}
+
+			_savedSectorCount = _sectorCount;
+			_saveTimestamp = esp_timer_get_time();
+			return true;
+		}
+
+		void FirmwareSectorMap::erase()
+		{
+			nvs_handle_t handle;
+
+			if ( nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK )
+			{
+				nvs_erase_key(handle, NVS_KEY_INFO);
+				nvs_erase_key(handle, NVS_KEY_CRCS);
+				nvs_commit(handle);
+				nvs_close(handle);
+			}
+
+			_savedSectorCount = 0;
+		}
+
+		bool FirmwareSectorMap::allocate(const esp_partition_t *partition, size_t imageSize)
+		{
+			end();
+
+			_maxSectors = (partition->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+			_sectorCRCs = new uint32_t[_maxSectors];
+
+			if ( _sectorCRCs == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "could not allocate memory for sector map");
+				_maxSectors = 0;
+				return false;
+			}
+
+			_partition = partition;
+			_imageSize = imageSize;
+			_currentCRC = 0;
+			_currentLength = 0;
+			_valid = true;
+
+			return true;
+		}
+
+	}
+}
@@ -0,0 +1,138 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIRMWARESECTORMAP_H
+#define FIRMWARESECTORMAP_H
+
+extern "C"
+{
+	#include "esp_partition.h"
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The FirmwareSectorMap class records a CRC32 per written flash sector of an update.
+         *
+         * The CRCs are calculated with the ROM CRC kernel while the image is written and can be persisted
+         * in NVS, so after a power loss only the recorded sectors have to be re-read to find the intact
+         * part of the update partition. A persistent map is saved when it begins, after the first sector
+         * and then every few sectors or seconds. The map detects incomplete and corrupted writes, it does not
+         * replace the signature check of the complete image.
+         */
+		class FirmwareSectorMap
+		{
+			public:
+
+									FirmwareSectorMap();
+									~FirmwareSectorMap();
+
+                /**
+                 * @brief           Persist the map in NVS while the update is written, nvs_flash has to be initialized
+                 */
+				void				setPersistent(bool persistent);
+				bool				isPersistent() const;
+
+                /**
+                 * @brief           Start an empty map for a new update, replaces a persisted map with the empty one
+                 *
+                 * @param partition     the update partition
+                 * @param imageSize     the image size of the transaction, stored to match a later resume
+                 *
+                 * @return          \c true if memory for the map could be allocated, otherwise \c false
+                 */
+				bool				begin(const esp_partition_t* partition, size_t imageSize);
+
+                /**
+                 * @brief           Load the persisted map of an interrupted update
+                 *
+                 * @return          \c true if a map for the same partition and image size was found, otherwise \c false
+                 */
+				bool				load(const esp_partition_t* partition, size_t imageSize);
+
+                /**
+                 * @brief           Release the map, the persisted map is kept
+                 */
+				void				end();
+
+                /**
+                 * @brief           Add sequentially written image data, completed sectors are recorded
+                 */
+				void				addData(const void* data, size_t size);
+
+                /**
+                 * @brief           Stop recording, e.g. for out of order writes, and remove the persisted map
+                 */
+				void				invalidate();
+
+                /**
+                 * @brief           Re-read recorded sectors from flash and compare their CRC
+                 *
+                 * @param firstSector   first sector to check
+                 * @param count         number of sectors to check
+                 *
+                 * @return          number of intact sectors from firstSector up to the first mismatch
+                 */
+				size_t				checkSectors(size_t firstSector, size_t count) const;
+
+                /**
+                 * @brief           Drop all sectors from sectorCount on, recording continues after them
+                 */
+				void				truncate(size_t sectorCount);
+
+				size_t				getSectorCount() const;
+
+                /**
+                 * @brief           Write the map to NVS
+                 */
+				bool				save();
+
+                /**
+                 * @brief           Remove the map from NVS
+                 */
+				void				erase();
+
+			private:
+
+				struct MapInfo
+				{
+					uint32_t	magic;
+					uint32_t	partitionAddress;
+					uint32_t	imageSize;
+					uint32_t	sectorCount;
+				};
+
+				bool				allocate(const esp_partition_t* partition, size_t imageSize);
+
+				const esp_partition_t*	_partition = { nullptr };
+				uint32_t				_imageSize = { 0 };
+				uint32_t*				_sectorCRCs = { nullptr };
+				size_t					_maxSectors = { 0 };
+				size_t					_sectorCount = { 0 };
+				size_t					_savedSectorCount = { 0 };
+				int64_t					_saveTimestamp = { 0 };
+				uint32_t				_currentCRC = { 0 };
+				size_t					_currentLength = { 0 };
+				bool					_valid = { false };
+				bool					_persistent = { false };
+		};
+	}
+}
+
+#endif // FIRMWARESECTORMAP_H
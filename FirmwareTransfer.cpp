@@ -0,0 +1,601 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FirmwareTransfer.h"
+#include "IFirmwareSource.h"
+#include "IFirmwareWriter.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_timer.h>
+	#include <esp_heap_caps.h>
+	#include <stdlib.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::FirmwareTransfer";
+	const uint32_t	ADAPT_WINDOW_READS			= 4;		// reads measured per read size
+	const uint32_t	MIN_IMPROVEMENT_PERCENT		= 10;		// throughput gain that justifies a larger buffer
+	const int64_t	MICROSECONDS_PER_SECOND		= 1000000;
+	const int64_t	STALL_TIMEOUT_US			= 30 * MICROSECONDS_PER_SECOND;
+	const int64_t	EMPTY_READ_RETRY_US			= 10000;
+	const size_t	READ_BUFFER_ALIGNMENT		= 32;		// cache line size, lets DMA capable drivers use the buffer directly
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		FirmwareTransfer::FirmwareTransfer()
+		{
+
+		}
+
+		FirmwareTransfer::~FirmwareTransfer()
+		{
+			closeOpenTransfer();
+		}
+
+		void FirmwareTransfer::setFirmwareSource(IFirmwareSource *source)
+		{
+			_firmwareSource = source;
+		}
+
+		void FirmwareTransfer::setSourceOffset(size_t offset)
+		{
+			_sourceOffset = offset;
+		}
+
+		void FirmwareTransfer::setFirmwareWriter(IFirmwareWriter *writer)
+		{
+			_firmwareWriter = writer;
+		}
+
+		int FirmwareTransfer::transferFirmware()
+		{
+			if ( beginTransfer() == false )
+			{
+				return -1;
+			}
+
+			return runTransfer();
+		}
+
+		bool FirmwareTransfer::beginTransfer(FinishedCallback onFinished)
+		{
+			State state = _state;
+
+			if ( state == State::Running || state == State::Throttled || _backgroundRunning )
+			{
+				ESP_LOGE(LOG_TAG, "Transfer error: transfer already running!");
+				return false;
+			}
+
+			_cancelRequested = false;
+			return openTransfer(onFinished);
+		}
+
+		bool FirmwareTransfer::openTransfer(FinishedCallback onFinished)
+		{
+			if ( _firmwareSource == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "Transfer error: no firmware source set!");
+				return false;
+			}
+
+			if ( _firmwareWriter == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "Transfer error: no firmware writer set!");
+				return false;
+			}
+
+			size_t offset = _sourceOffset;
+			_sourceOffset = 0;
+
+			if ( _firmwareSource->open(offset) == false )
+			{
+				ESP_LOGE(LOG_TAG, "Failed to open firmware source at offset %zu", offset);
+				return false;
+			}
+
+			_contentLength = _firmwareSource->contentLength();
+			ESP_LOGI(LOG_TAG, "Content length: %d", _contentLength);
+
+			_directRead = _firmwareSource->supportsDirectRead();
+
+			// the preference of the source may raise the configured maximum
+			size_t preferredReadSize = _firmwareSource->preferredReadSize();
+			_maxReadSize = preferredReadSize > _bufferConfig.maxReadSize ? preferredReadSize : _bufferConfig.maxReadSize;
+
+			if ( _directRead )
+			{
+				// no buffer to pay for, so always hand the largest chunks to the writer
+				_readSize = _maxReadSize;
+			}
+			else
+			{
+				size_t readSize = preferredReadSize;
+
+				if ( readSize < _bufferConfig.minReadSize )
+				{
+					readSize = _bufferConfig.minReadSize;
+				}
+
+				if ( resizeReadBuffer(readSize) == false )
+				{
+					ESP_LOGE(LOG_TAG, "could not allocate memory for read buffer");
+					_firmwareSource->close();
+					return false;
+				}
+			}
+
+			_totalReadBytes = 0;
+			_windowReads = 0;
+			_windowBytes = 0;
+			_windowUs = 0;
+			_lastThroughput = 0;
+			_previousReadSize = _readSize;
+			_readSizeSettled = false;
+			_stats = Stats();
+			_stats.minReadSize = _readSize;
+			_stats.maxReadSize = _readSize;
+			_finishedCallback = onFinished;
+
+			_bucketTokens = 0;
+			_bucketTimestamp = esp_timer_get_time();
+			_nextStepTimestamp = 0;
+			_lastProgressTimestamp = _bucketTimestamp;
+			_startTimestamp = _bucketTimestamp;
+
+			_state = State::Running;
+			return true;
+		}
+
+		FirmwareTransfer::State FirmwareTransfer::step()
+		{
+			if ( _state != State::Running && _state != State::Throttled )
+			{
+				return _state;
+			}
+
+			if ( _cancelRequested )
+			{
+				ESP_LOGW(LOG_TAG, "Transfer cancelled");
+				return finishTransfer(State::Cancelled);
+			}
+
+			if ( getStepDelayUs() > 0 )
+			{
+				_state = State::Throttled;
+				return _state;
+			}
+
+			const void* data = nullptr;
+			int64_t readStart = esp_timer_get_time();
+			int currentReadBytes = readChunk(&data);
+
+			if ( currentReadBytes < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not read from firmware source...");
+				return finishTransfer(State::Failed);
+			}
+
+			if ( currentReadBytes == 0 )
+			{
+				return handleEmptyRead();
+			}
+
+			_totalReadBytes = _totalReadBytes + currentReadBytes;
+			_lastProgressTimestamp = esp_timer_get_time();
+
+			if ( contentLengthKnown() )
+			{
+				ESP_LOGI(LOG_TAG, "[*] %.*f %% | Transferred %d from %d Bytes", 2, (100.0f / _contentLength) * _totalReadBytes, _totalReadBytes, _contentLength );
+			}
+			else
+			{
+				ESP_LOGI(LOG_TAG, "[*] Transferred %d Bytes", _totalReadBytes );
+			}
+
+			esp_err_t errorCode;
+			int64_t writeStart = esp_timer_get_time();
+
+			if ( (errorCode = _firmwareWriter->writeFirmwareBytes(data, currentReadBytes) ) != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "failed writeFirmwareBytes with result %s", esp_err_to_name(errorCode) );
+				return finishTransfer(State::Failed);
+			}
+
+			throttleWrite(esp_timer_get_time() - writeStart);
+			throttleBandwidth(currentReadBytes);
+
+			if ( _directRead == false )
+			{
+				adaptReadSize(currentReadBytes, esp_timer_get_time() - readStart);
+			}
+
+			if ( contentLengthKnown() && _totalReadBytes >= _contentLength )
+			{
+				return finishTransfer(State::Finished);
+			}
+
+			_state = getStepDelayUs() > 0 ? State::Throttled : State::Running;
+			return _state;
+		}
+
+		int FirmwareTransfer::readChunk(const void **data)
+		{
+			if ( _directRead )
+			{
+				return _firmwareSource->readDirect(data, _readSize);
+			}
+
+			*data = _readBuffer;
+			return _firmwareSource->read(_readBuffer, _readSize);
+		}
+
+		FirmwareTransfer::State FirmwareTransfer::handleEmptyRead()
+		{
+			if ( _firmwareSource->isComplete() )
+			{
+				if ( contentLengthKnown() && _totalReadBytes < _contentLength )
+				{
+					ESP_LOGE(LOG_TAG, "firmware stream truncated after %d from %d Bytes", _totalReadBytes, _contentLength);
+					return finishTransfer(State::Failed);
+				}
+
+				return finishTransfer(State::Finished);
+			}
+
+			if ( esp_timer_get_time() - _lastProgressTimestamp > STALL_TIMEOUT_US )
+			{
+				ESP_LOGE(LOG_TAG, "firmware stream stalled after %d Bytes", _totalReadBytes);
+				return finishTransfer(State::Failed);
+			}
+
+			// non blocking sources return at once, retrying right away would spin and starve the idle task
+			int64_t retry = esp_timer_get_time() + EMPTY_READ_RETRY_US;
+			if ( retry > _nextStepTimestamp )
+			{
+				_nextStepTimestamp = retry;
+			}
+
+			_state = State::Throttled;
+			return _state;
+		}
+
+		void FirmwareTransfer::cancel()
+		{
+			_cancelRequested = true;
+		}
+
+		FirmwareTransfer::State FirmwareTransfer::getState() const
+		{
+			return _state;
+		}
+
+		int64_t FirmwareTransfer::getStepDelayUs() const
+		{
+			int64_t delay = _nextStepTimestamp - esp_timer_get_time();
+			return delay > 0 ? delay : 0;
+		}
+
+		int FirmwareTransfer::runTransfer()
+		{
+			State state;
+
+			while ( (state = step()) == State::Running || state == State::Throttled )
+			{
+				if ( state == State::Throttled )
+				{
+					// round up, waking up early would only spin through another throttled step
+					vTaskDelay( pdMS_TO_TICKS( (getStepDelayUs() + 999) / 1000 ) + 1 );
+				}
+			}
+
+			return state == State::Finished ? 0 : -1;
+		}
+
+		void FirmwareTransfer::closeOpenTransfer()
+		{
+			if ( _backgroundRunning )
+			{
+				// the task would continue on a deleted object
+				ESP_LOGE(LOG_TAG, "Transfer deleted while its background task is running!");
+				abort();
+			}
+
+			State state = _state;
+
+			if ( state == State::Running || state == State::Throttled )
+			{
+				_finishedCallback = nullptr;
+				finishTransfer(State::Cancelled);
+			}
+		}
+
+		FirmwareTransfer::State FirmwareTransfer::finishTransfer(State state)
+		{
+			heap_caps_free(_readBuffer);
+			_readBuffer = nullptr;
+
+			_stats.totalBytes = _totalReadBytes;
+			_stats.readSize = _readSize;
+			_stats.durationUs = esp_timer_get_time() - _startTimestamp;
+			if ( _stats.durationUs > 0 )
+			{
+				_stats.bytesPerSecond = static_cast<uint32_t>(_totalReadBytes * MICROSECONDS_PER_SECOND / _stats.durationUs);
+			}
+
+			ESP_LOGI(LOG_TAG, "%d Bytes in %lld ms (%u B/s), read size %zu (%zu - %zu), %u resizes", _stats.totalBytes, static_cast<long long>(_stats.durationUs / 1000),
+					 _stats.bytesPerSecond, _stats.readSize, _stats.minReadSize, _stats.maxReadSize, _stats.resizeCount);
+
+			_firmwareSource->close();
+
+			_state = state;
+
+			if ( _finishedCallback )
+			{
+				FinishedCallback callback = _finishedCallback;
+				_finishedCallback = nullptr;
+				callback(state == State::Finished ? 0 : -1);
+			}
+
+			return state;
+		}
+
+		void FirmwareTransfer::setThrottle(const ThrottleConfig &config)
+		{
+			_throttle = config;
+
+			if ( _throttle.writeDutyCyclePercent == 0 )
+			{
+				_throttle.writeDutyCyclePercent = 1;
+			}
+			else if ( _throttle.writeDutyCyclePercent > 100 )
+			{
+				_throttle.writeDutyCyclePercent = 100;
+			}
+		}
+
+		bool FirmwareTransfer::startBackgroundTransfer(UBaseType_t priority, BaseType_t coreID, FinishedCallback onFinished, uint32_t stackSize)
+		{
+			State state = _state;
+
+			if ( _backgroundRunning || state == State::Running || state == State::Throttled )
+			{
+				ESP_LOGE(LOG_TAG, "Background transfer already running!");
+				return false;
+			}
+
+			// set up here and not in the task, a cancel() right after the start must not be lost
+			_backgroundCallback = onFinished;
+			_cancelRequested = false;
+			_backgroundRunning = true;
+			_state = State::Running;
+
+			if ( xTaskCreatePinnedToCore(&FirmwareTransfer::backgroundTransferTask, "fota_transfer", stackSize, this, priority, nullptr, coreID) != pdPASS )
+			{
+				ESP_LOGE(LOG_TAG, "could not create background transfer task");
+				_backgroundCallback = nullptr;
+				_backgroundRunning = false;
+				_state = state;
+				return false;
+			}
+
+			return true;
+		}
+
+		bool FirmwareTransfer::isBackgroundTransferRunning() const
+		{
+			return _backgroundRunning;
+		}
+
+		void FirmwareTransfer::backgroundTransferTask(void *arg)
+		{
+			FirmwareTransfer* transfer = static_cast<FirmwareTransfer*>(arg);
+			FinishedCallback callback = transfer->_backgroundCallback;
+			transfer->_backgroundCallback = nullptr;
+
+			int result = -1;
+
+			if ( transfer->_cancelRequested )
+			{
+				ESP_LOGW(LOG_TAG, "Transfer cancelled");
+				transfer->_state = State::Cancelled;
+			}
+			else if ( transfer->openTransfer(nullptr) )
+			{
+				result = transfer->runTransfer();
+			}
+			else
+			{
+				transfer->_state = State::Failed;
+			}
+
+			// the callback may delete the transfer, it must not be touched afterwards
+			transfer->_backgroundRunning = false;
+
+			if ( callback )
+			{
+				callback(result);
+			}
+
+			vTaskDelete(nullptr);
+		}
+
+		void FirmwareTransfer::setBufferConfig(const BufferConfig &config)
+		{
+			_bufferConfig = config;
+
+			if ( _bufferConfig.minReadSize == 0 )
+			{
+				_bufferConfig.minReadSize = BufferConfig().minReadSize;
+			}
+
+			if ( _bufferConfig.maxReadSize < _bufferConfig.minReadSize )
+			{
+				_bufferConfig.maxReadSize = _bufferConfig.minReadSize;
+			}
+		}
+
+		const FirmwareTransfer::Stats &FirmwareTransfer::getStats() const
+		{
+			return _stats;
+		}
+
+		bool FirmwareTransfer::resizeReadBuffer(size_t size)
+		{
+			char* buffer = static_cast<char*>(heap_caps_aligned_alloc(READ_BUFFER_ALIGNMENT, size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT));
+
+			if ( buffer == nullptr )
+			{
+				// DMA capable memory is internal RAM only, any buffer is better than none
+				buffer = static_cast<char*>(heap_caps_aligned_alloc(READ_BUFFER_ALIGNMENT, size, MALLOC_CAP_8BIT));
+			}
+
+			if ( buffer == nullptr )
+			{
+				return false;
+			}
+
+			heap_caps_free(_readBuffer);
+			_readBuffer = buffer;
+			_readSize = size;
+
+			return true;
+		}
+
+		void FirmwareTransfer::adaptReadSize(int lastReadBytes, int64_t stepUs)
+		{
+			size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+			size_t newSize = _readSize;
+
+			_windowReads++;
+			_windowBytes += lastReadBytes;
+			_windowUs += stepUs;
+
+			if ( freeHeap < _bufferConfig.minFreeHeap )
+			{
+				newSize = _readSize / 2 > _bufferConfig.minReadSize ? _readSize / 2 : _bufferConfig.minReadSize;
+				_readSizeSettled = true;
+			}
+			else if ( _readSizeSettled == false && _windowReads >= ADAPT_WINDOW_READS )
+			{
+				// a full buffer says nothing, esp_http_client_read loops until it is full, so only grow while it pays off
+				int64_t throughput = _windowBytes * MICROSECONDS_PER_SECOND / (_windowUs > 0 ? _windowUs : 1);
+
+				if ( _lastThroughput > 0 && throughput * 100 < _lastThroughput * (100 + MIN_IMPROVEMENT_PERCENT) )
+				{
+					// the last doubling did not pay off, go back to the previous size for good
+					newSize = _previousReadSize;
+					_readSizeSettled = true;
+				}
+				else
+				{
+					size_t candidate = _readSize * 2 < _maxReadSize ? _readSize * 2 : _maxReadSize;
+
+					if ( candidate > _readSize && freeHeap >= candidate + _bufferConfig.minFreeHeap
+						 && heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= candidate )
+					{
+						newSize = candidate;
+						_previousReadSize = _readSize;
+						_lastThroughput = throughput;
+					}
+					else
+					{
+						_readSizeSettled = true;
+					}
+				}
+
+				ESP_LOGD(LOG_TAG, "read size %zu: %lld B/s", _readSize, static_cast<long long>(throughput));
+			}
+
+			if ( newSize != _readSize || _windowReads >= ADAPT_WINDOW_READS )
+			{
+				_windowReads = 0;
+				_windowBytes = 0;
+				_windowUs = 0;
+			}
+
+			if ( newSize == _readSize || resizeReadBuffer(newSize) == false )
+			{
+				return;
+			}
+
+			ESP_LOGD(LOG_TAG, "read size changed to %zu bytes, free heap %zu bytes", _readSize, freeHeap);
+
+			_stats.resizeCount++;
+			if ( _readSize < _stats.minReadSize )
+			{
+				_stats.minReadSize = _readSize;
+			}
+			if ( _readSize > _stats.maxReadSize )
+			{
+				_stats.maxReadSize = _readSize;
+			}
+		}
+
+		void FirmwareTransfer::throttleBandwidth(size_t bytes)
+		{
+			if ( _throttle.maxBytesPerSecond == 0 )
+			{
+				return;
+			}
+
+			int64_t bucketSize = _throttle.burstBytes > 0 ? _throttle.burstBytes : _throttle.maxBytesPerSecond;
+			int64_t now = esp_timer_get_time();
+
+			_bucketTokens += (now - _bucketTimestamp) * _throttle.maxBytesPerSecond / MICROSECONDS_PER_SECOND;
+			_bucketTimestamp = now;
+
+			if ( _bucketTokens > bucketSize )
+			{
+				_bucketTokens = bucketSize;
+			}
+
+			_bucketTokens -= bytes;
+
+			if ( _bucketTokens < 0 )
+			{
+				// wait until the debt is paid off, the refill above accounts for the time actually waited
+				int64_t resume = now - _bucketTokens * MICROSECONDS_PER_SECOND / _throttle.maxBytesPerSecond;
+				if ( resume > _nextStepTimestamp )
+				{
+					_nextStepTimestamp = resume;
+				}
+			}
+		}
+
+		void FirmwareTransfer::throttleWrite(int64_t writeTimeUs)
+		{
+			if ( _throttle.writeDutyCyclePercent >= 100 )
+			{
+				return;
+			}
+
+			int64_t resume = esp_timer_get_time() + writeTimeUs * (100 - _throttle.writeDutyCyclePercent) / _throttle.writeDutyCyclePercent;
+			if ( resume > _nextStepTimestamp )
+			{
+				_nextStepTimestamp = resume;
+			}
+		}
+
+	}
+}
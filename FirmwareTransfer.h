@@ -0,0 +1,333 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIRMWARETRANSFER_H
+#define FIRMWARETRANSFER_H
+
+extern "C"
+{
+	#include "esp_err.h"
+	#include "freertos/FreeRTOS.h"
+	#include "freertos/task.h"
+}
+
+#include <atomic>
+#include <functional>
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		class IFirmwareSource;
+		class IFirmwareWriter;
+
+        /**
+         * @brief The FirmwareTransfer class reads a firmware image from an IFirmwareSource and writes it via an IFirmwareWriter.
+         *
+         * The transfer can either be run blocking with transferFirmware(), or step driven from an existing
+         * task or event loop with beginTransfer() and step(). Each step reads and writes at most one read buffer.
+         *
+         * Step driven does not mean non-blocking: beginTransfer() blocks while the source is opened (for HTTP the
+         * connect, TLS handshake and response headers) and step() blocks until the read buffer is filled or the
+         * source times out (esp_http_client_read loops until the buffer is full), plus the flash write. A step is
+         * bounded by BufferConfig::maxReadSize (raised to the preferred read size of the source) and the timeout
+         * of the source, e.g. \c timeout_ms of the HTTP configuration. Lower both to keep steps short, or use
+         * startBackgroundTransfer() where an event loop must not block at all.
+         */
+		class FirmwareTransfer
+		{
+			public:
+
+				enum class State
+				{
+					Idle,
+					Running,	///< next call to step() will transfer data
+					Throttled,	///< next call to step() would exceed the throttle or the source had no data, see getStepDelayUs()
+					Finished,
+					Failed,
+					Cancelled
+				};
+
+                /**
+                 * @brief The ThrottleConfig struct limits the impact of a transfer on the rest of the system.
+                 *
+                 * The bandwidth is limited by a token bucket which is refilled with \c maxBytesPerSecond and
+                 * can hold up to \c burstBytes. The write duty cycle limits the share of time spent in
+                 * IFirmwareWriter::writeFirmwareBytes, e.g. a value of 25 idles three times as long as the
+                 * previous flash write took. Flash erases are only throttled if the writer erases while writing,
+                 * see FirmwareUpdater::beginUpdate with OTA_WITH_SEQUENTIAL_WRITES.
+                 */
+				struct ThrottleConfig
+				{
+					uint32_t	maxBytesPerSecond = { 0 };		///< 0 = unlimited
+					uint32_t	burstBytes = { 0 };				///< 0 = one second worth of maxBytesPerSecond
+					uint8_t		writeDutyCyclePercent = { 100 };	///< 1 - 100, 100 = no idle time after writes
+				};
+
+                /**
+                 * @brief The BufferConfig struct sets the bounds of the adaptive read size.
+                 *
+                 * The read size starts at \c minReadSize (or the preferred read size of the source). The throughput of
+                 * reading and writing is measured over several reads per size, the size is doubled as long as that
+                 * improves it noticeably, up to \c maxReadSize or the preferred read size of the source if that is
+                 * larger. It is halved as long as the free heap is below \c minFreeHeap.
+                 * The buffer is allocated from DMA capable memory if possible.
+                 */
+				struct BufferConfig
+				{
+					size_t		minReadSize = { 1024 };
+					size_t		maxReadSize = { 16384 };
+					size_t		minFreeHeap = { 32768 };
+				};
+
+                /**
+                 * @brief The Stats struct reports the last transfer, valid once the transfer finished.
+                 */
+				struct Stats
+				{
+					int			totalBytes = { 0 };
+					int64_t		durationUs = { 0 };
+					uint32_t	bytesPerSecond = { 0 };
+					size_t		readSize = { 0 };			///< read size at the end of the transfer
+					size_t		minReadSize = { 0 };		///< smallest read size used
+					size_t		maxReadSize = { 0 };		///< largest read size used
+					uint32_t	resizeCount = { 0 };
+				};
+
+				using FinishedCallback = std::function<void(int result)>;
+
+				/// enough for the HTTPS handshake, which runs in the transfer task when the source is opened
+				static const uint32_t	DEFAULT_BACKGROUND_STACK_SIZE = 8192;
+
+									FirmwareTransfer();
+
+                /**
+                 * @brief           Close a step driven transfer that is still open, without calling its finished callback
+                 *
+                 * A background transfer must have ended before the transfer is deleted, its task uses the object
+                 * until the finished callback is called.
+                 */
+				virtual				~FirmwareTransfer();
+
+                /**
+                 * @brief           Set the IFirmwareSource the firmware is read from
+                 * @param source    the IFirmwareSource providing the firmware
+                 */
+				void				setFirmwareSource(IFirmwareSource* source);
+
+                /**
+                 * @brief           Start the next transfer at an image offset instead of the start of the image
+                 *
+                 * Used to continue an update resumed by FirmwareUpdater::resumeUpdate() at its resumeOffset. The
+                 * offset only applies to the next transfer, which fails if the source cannot start there.
+                 *
+                 * @param offset    image offset the source is opened at
+                 */
+				void				setSourceOffset(size_t offset);
+
+                /**
+                 * @brief           Set the IFirmwareWriter used to write the firmware
+                 * @param writer    the IFirmwareWriter used to write the firmware
+                 */
+				void				setFirmwareWriter(IFirmwareWriter* writer);
+
+                /**
+                 * @brief           Transfer the whole firmware, blocks the calling task until done
+                 *
+                 * @return          \c 0 if the transfer was successful
+                 * @return          \c -1 if the transfer failed
+                 */
+				int					transferFirmware();
+
+                /**
+                 * @brief           Open the source for a step driven transfer
+                 *
+                 * Blocks until the source is open, see the class description.
+                 *
+                 * @param onFinished    optional callback, called with the transferFirmware() compatible result
+                 *                      when the transfer finished, failed or was cancelled
+                 *
+                 * @return          \c true if the source was opened and step() can be called, otherwise \c false
+                 */
+				bool				beginTransfer(FinishedCallback onFinished = nullptr);
+
+                /**
+                 * @brief           Perform one bounded unit of work: read at most one read buffer and write it
+                 *
+                 * Never blocks on throttling - if the throttle does not allow a transfer yet, nothing is done and
+                 * State::Throttled is returned. Reading and writing do block, see the class description.
+                 *
+                 * @return          the state of the transfer after this step
+                 */
+				State				step();
+
+                /**
+                 * @brief           Request to cancel the running transfer
+                 *
+                 * Can be called from any task, the source is closed by the next call to step(). A background transfer
+                 * cancelled before its task opened the source ends without opening it.
+                 */
+				void				cancel();
+
+				State				getState() const;
+
+                /**
+                 * @brief           Get the time until the next step() is allowed to transfer data
+                 * @return          remaining time in microseconds, \c 0 if the next step can transfer immediately
+                 */
+				int64_t				getStepDelayUs() const;
+
+                /**
+                 * @brief           Set the throttling used by all following transfers
+                 * @param config    the bandwidth and write duty cycle limits, default constructed means unthrottled
+                 */
+				void				setThrottle(const ThrottleConfig& config);
+
+                /**
+                 * @brief           Set the bounds for the adaptive read size used by all following transfers
+                 */
+				void				setBufferConfig(const BufferConfig& config);
+
+                /**
+                 * @brief           Get the statistics of the last transfer
+                 */
+				const Stats&		getStats() const;
+
+                /**
+                 * @brief           Run the transfer in a separate FreeRTOS task
+                 *
+                 * @param priority      priority of the transfer task, should be below the time critical tasks
+                 * @param coreID        core the transfer task is pinned to or \c tskNO_AFFINITY
+                 * @param onFinished    optional callback, called from the transfer task with the transferFirmware result,
+                 *                      isBackgroundTransferRunning() is already \c false and the callback may delete the transfer
+                 * @param stackSize     stack size of the transfer task in bytes, has to cover the source (e.g. TLS) and the writer
+                 *
+                 * @return          \c true if the transfer task was started, otherwise \c false
+                 */
+				bool				startBackgroundTransfer(UBaseType_t priority, BaseType_t coreID = tskNO_AFFINITY, FinishedCallback onFinished = nullptr,
+															uint32_t stackSize = DEFAULT_BACKGROUND_STACK_SIZE);
+
+                /**
+                 * @brief           Check if a transfer started with startBackgroundTransfer is still running
+                 */
+				bool				isBackgroundTransferRunning() const;
+
+			protected:
+
+                /**
+                 * @brief           Close a step driven transfer that is still open, without calling its finished callback
+                 *
+                 * Called by the destructor, derived classes that own the source call it in their destructor,
+                 * before the source is destroyed.
+                 */
+				void				closeOpenTransfer();
+
+			private:
+
+				static void			backgroundTransferTask(void* arg);
+
+                /**
+                 * @brief           Open the source and reset the transfer, leaves a pending cancel request untouched
+                 */
+				bool				openTransfer(FinishedCallback onFinished);
+
+                /**
+                 * @brief           Call step() until the transfer is done, delaying the calling task while throttled
+                 * @return          the transferFirmware() compatible result
+                 */
+				int					runTransfer();
+
+                /**
+                 * @brief           Read the next chunk, either directly from the source or into the read buffer
+                 */
+				int					readChunk(const void** data);
+
+                /**
+                 * @brief           Handle a read without data: end of stream, truncated stream or stalled source
+                 */
+				State				handleEmptyRead();
+
+                /**
+                 * @brief           Check if the source announced the content length (e.g. not the case for chunked HTTP transfers)
+                 */
+				inline bool			contentLengthKnown() const { return _contentLength > 0; }
+
+                /**
+                 * @brief           Close the source, release the buffer and report the final state
+                 */
+				State				finishTransfer(State state);
+
+                /**
+                 * @brief           Replace the read buffer, the current buffer is kept if the allocation fails
+                 */
+				bool				resizeReadBuffer(size_t size);
+
+                /**
+                 * @brief           Grow the read size while the throughput improves, shrink it while the heap runs low
+                 *
+                 * @param lastReadBytes number of bytes transferred by the step
+                 * @param stepUs        time spent reading and writing them, without throttling
+                 */
+				void				adaptReadSize(int lastReadBytes, int64_t stepUs);
+
+                /**
+                 * @brief           Take bytes from the token bucket and postpone the next step if the bucket is empty
+                 */
+				void				throttleBandwidth(size_t bytes);
+
+                /**
+                 * @brief           Postpone the next step to keep the configured write duty cycle
+                 * @param writeTimeUs   duration of the previous write in microseconds
+                 */
+				void				throttleWrite(int64_t writeTimeUs);
+
+				IFirmwareSource*			_firmwareSource = { nullptr };
+				size_t						_sourceOffset = { 0 };
+				IFirmwareWriter*			_firmwareWriter = { nullptr };
+
+				std::atomic<State>			_state = { State::Idle };
+				std::atomic<bool>			_cancelRequested = { false };
+				FinishedCallback			_finishedCallback;
+				bool						_directRead = { false };
+				char*						_readBuffer = { nullptr };
+				size_t						_readSize = { 0 };
+				size_t						_maxReadSize = { 0 };
+				uint32_t					_windowReads = { 0 };
+				int64_t						_windowBytes = { 0 };
+				int64_t						_windowUs = { 0 };
+				int64_t						_lastThroughput = { 0 };		///< bytes per second at _previousReadSize
+				size_t						_previousReadSize = { 0 };
+				bool						_readSizeSettled = { false };
+				int							_contentLength = { 0 };
+				int							_totalReadBytes = { 0 };
+				BufferConfig				_bufferConfig;
+				Stats						_stats;
+				int64_t						_startTimestamp = { 0 };
+				int64_t						_lastProgressTimestamp = { 0 };
+
+				ThrottleConfig				_throttle;
+				int64_t						_bucketTokens = { 0 };
+				int64_t						_bucketTimestamp = { 0 };
+				int64_t						_nextStepTimestamp = { 0 };
+
+				FinishedCallback			_backgroundCallback;
+				std::atomic<bool>			_backgroundRunning = { false };
+		};
+	}
+}
+
+#endif // FIRMWARETRANSFER_H
@@ -24,6 +24,8 @@
 extern "C"
 {
 	#include <esp_log.h>
+	#include <esp_rom_crc.h>
+	#include <esp_timer.h>
 	#include <string.h>
 }
 
@@ -31,6 +33,10 @@ namespace
 {
 	const char*		LOG_TAG					= "IDFix::FirmwareUpdater";
 	const size_t	HASH_READ_BUFFER_SIZE	= 256;
+	const size_t	HASH_HOLDBACK_SIZE		= 1024;			// largest signature + length that can be hashed while writing
+	const size_t	CACHE_COPY_BUFFER_SIZE	= 4096;
+	const uint32_t	SIGNATURE_LENGTH_MASK	= 0x00FFFFFF;
+	const uint32_t	SIGNATURE_SCHEME_SHIFT	= 24;
 }
 
 namespace IDFix
@@ -74,6 +80,90 @@ namespace IDFix
 				return false;
 			}
 
+			beginStreamHash();
+
+			// without resume nothing needs the map, it costs a partition sized CRC array and NVS writes
+			if ( _sectorMap.isPersistent() )
+			{
+				_sectorMap.begin(_updatePartition, imageSize);
+			}
+
+			_sequentialErase = imageSize == OTA_WITH_SEQUENTIAL_WRITES;
+
+			// an image installed from the cache is already there
+			_cacheWriting = _imageCache != nullptr && _installingFromCache == false
+							&& _imageCache->beginWrite(_sequentialErase ? OTA_SIZE_UNKNOWN : imageSize);
+
+			return true;
+		}
+
+		bool FirmwareUpdater::resumeUpdate(size_t imageSize, size_t *resumeOffset, const esp_partition_t *updatePartition)
+		{
+			if ( ! lockUpdate() )
+			{
+				return false;
+			}
+
+			if ( updatePartition == nullptr )
+			{
+				updatePartition = esp_ota_get_next_update_partition(nullptr);
+				if ( updatePartition == nullptr )
+				{
+					ESP_LOGE(LOG_TAG, "Failed to get available update partition. Aborting...");
+					unlockUpdate();
+					return false;
+				}
+			}
+
+			if ( _sectorMap.load(updatePartition, imageSize) == false )
+			{
+				ESP_LOGW(LOG_TAG, "No interrupted update to resume");
+				unlockUpdate();
+				return false;
+			}
+
+			int64_t start = esp_timer_get_time();
+			size_t intactSectors = _sectorMap.checkSectors(0, _sectorMap.getSectorCount());
+			size_t intactBytes = intactSectors * SPI_FLASH_SEC_SIZE;
+
+			ESP_LOGI(LOG_TAG, "%zu of %zu recorded sectors intact, checked in %lld us", intactSectors, _sectorMap.getSectorCount(),
+					 static_cast<long long>(esp_timer_get_time() - start));
+
+			_sectorMap.truncate(intactSectors);
+
+			// the remaining sectors are erased here, as esp_ota_write_with_offset does not erase
+			size_t eraseEnd = updatePartition->size;
+
+			if ( imageSize != OTA_SIZE_UNKNOWN && imageSize < eraseEnd )
+			{
+				eraseEnd = (imageSize + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+			}
+
+			esp_err_t result = esp_ota_begin(updatePartition, OTA_WITH_SEQUENTIAL_WRITES, &_updateHandle);
+
+			if ( result == ESP_OK && eraseEnd > intactBytes )
+			{
+				result = esp_partition_erase_range(updatePartition, intactBytes, eraseEnd - intactBytes);
+
+				if ( result != ESP_OK )
+				{
+					esp_ota_abort(_updateHandle);
+				}
+			}
+
+			if ( result != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "Resuming the update failed with result %s", esp_err_to_name(result) );
+				unlockUpdate();
+				return false;
+			}
+
+			// the streamed hash and the image cache need the whole image, the image is hashed from flash at the end
+			_updatePartition = updatePartition;
+			_firmwareSize = intactBytes;
+			_resumedUpdate = true;
+			*resumeOffset = intactBytes;
+
 			return true;
 		}
 
@@ -88,11 +178,71 @@ namespace IDFix
 		{
 			if ( isUpdateRunning() && _updateHandle != 0 )
 			{
-				esp_err_t result = esp_ota_write(_updateHandle, data, size);
+				// esp_ota_write always starts at the beginning of the partition and esp_ota_write_with_offset asserts
+				// on handles begun with OTA_WITH_SEQUENTIAL_WRITES, resumeUpdate erased the remaining range already
+				esp_err_t result = _resumedUpdate ? esp_partition_write(_updatePartition, _firmwareSize, data, size)
+												  : esp_ota_write(_updateHandle, data, size);
 
 				if ( result == ESP_OK )
 				{
 					_firmwareSize += size;
+					streamHash(static_cast<const unsigned char*>(data), size);
+					_sectorMap.addData(data, size);
+
+					if ( _cacheWriting && _imageCache->write(data, size) != ESP_OK )
+					{
+						ESP_LOGW(LOG_TAG, "could not write image cache, image will not be cached");
+						_imageCache->discard();
+						_cacheWriting = false;
+					}
+				}
+				else
+				{
+					// a gap in the image can never be repaired by later writes
+					_writeFailed = true;
+				}
+
+				return result;
+			}
+			return ESP_FAIL;
+		}
+
+		esp_err_t FirmwareUpdater::writeFirmwareBytesAt(size_t offset, const void *data, size_t size)
+		{
+			if ( isUpdateRunning() && _updateHandle != 0 )
+			{
+				// esp_ota_write_with_offset asserts on handles that erase as they write
+				if ( _sequentialErase || _resumedUpdate )
+				{
+					ESP_LOGE(LOG_TAG, "out of order writes need a transaction that erased the partition in beginUpdate");
+					return ESP_ERR_INVALID_STATE;
+				}
+
+				// out of order data can not be hashed on the fly, the image is hashed from flash at the end
+				_streamHashValid = false;
+
+				// the cache and the sector map are written sequentially as well
+				_sectorMap.invalidate();
+
+				if ( _cacheWriting )
+				{
+					_imageCache->discard();
+					_cacheWriting = false;
+				}
+
+				esp_err_t result = esp_ota_write_with_offset(_updateHandle, data, size, offset);
+
+				if ( result == ESP_OK )
+				{
+					// the image ends with the highest written byte, gaps are detected by the final check
+					if ( offset + size > _firmwareSize )
+					{
+						_firmwareSize = offset + size;
+					}
+				}
+				else
+				{
+					_writeFailed = true;
 				}
 
 				return result;
@@ -106,7 +256,14 @@ namespace IDFix
 			{
 				esp_err_t result;
 
-				result = esp_ota_end(_updateHandle);
+				// the transaction ends here either way, nothing is left to resume
+				if ( _sectorMap.isPersistent() )
+				{
+					_sectorMap.erase();
+				}
+
+				// esp_ota_end rejects a handle nothing was written through, esp_ota_set_boot_partition validates the image
+				result = _resumedUpdate ? esp_ota_abort(_updateHandle) : esp_ota_end(_updateHandle);
 
 				if ( result != ESP_OK )
 				{
@@ -115,6 +272,13 @@ namespace IDFix
 					return false;
 				}
 
+				if ( _writeFailed )
+				{
+					ESP_LOGE(LOG_TAG, "Firmware write failed during the transaction! Aborting firmware update...");
+					unlockUpdate();
+					return false;
+				}
+
 				if ( checkFirmware() == false )
 				{
 					ESP_LOGE(LOG_TAG, "Firmware check failed! Aborting firmware update...");
@@ -133,6 +297,12 @@ namespace IDFix
 
 				ESP_LOGI(LOG_TAG, "Firmware update finished successful, firmware size: %u bytes", _firmwareSize);
 
+				if ( _cacheWriting )
+				{
+					_imageCache->commit(signatureUsed());
+					_cacheWriting = false;
+				}
+
                 unlockUpdate();
 				return true;
 			}
@@ -145,7 +315,12 @@ namespace IDFix
 			{
 				esp_err_t result;
 
-				result = esp_ota_end(_updateHandle);
+				if ( _sectorMap.isPersistent() )
+				{
+					_sectorMap.erase();
+				}
+
+				result = _resumedUpdate ? esp_ota_abort(_updateHandle) : esp_ota_end(_updateHandle);
 
 				if ( result != ESP_OK )
 				{
@@ -220,17 +395,106 @@ namespace IDFix
 
 		bool FirmwareUpdater::installSignatureVerifier(SignatureVerifier *verifier, HashAlgorithm *hashAlgo)
 		{
-			if ( (verifier == nullptr) || (hashAlgo == nullptr) )
+			return installSignatureVerifier(SignatureScheme::Default, verifier, hashAlgo);
+		}
+
+		bool FirmwareUpdater::installSignatureVerifier(SignatureScheme scheme, SignatureVerifier *verifier, HashAlgorithm *hashAlgo)
+		{
+			size_t index = static_cast<size_t>(scheme);
+
+			if ( (verifier == nullptr) || (hashAlgo == nullptr) || (index >= SCHEME_COUNT) )
 			{
 				return false;
 			}
 
-			_signatureVerifier = verifier;
-			_hashAlgorithm = hashAlgo;
+			_signatureVerifiers[index] = verifier;
+			_hashAlgorithms[index] = hashAlgo;
+			_installedSchemes |= 1 << index;
 
 			return true;
 		}
 
+		const FirmwareUpdater::VerificationReport &FirmwareUpdater::getVerificationReport() const
+		{
+			return _verificationReport;
+		}
+
+		void FirmwareUpdater::setImageCache(FirmwareImageCache *cache)
+		{
+			_imageCache = cache;
+		}
+
+		bool FirmwareUpdater::installFromCache(FirmwareImageCache::Entry entry, const esp_partition_t *updatePartition)
+		{
+			FirmwareImageCache::EntryInfo info;
+
+			if ( _imageCache == nullptr || _imageCache->getEntryInfo(entry, &info) == false )
+			{
+				ESP_LOGE(LOG_TAG, "no cached image available");
+				return false;
+			}
+
+			unsigned char *copyBuffer = new unsigned char[CACHE_COPY_BUFFER_SIZE];
+
+			if ( copyBuffer == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "could not allocate memory for the cache copy buffer");
+				return false;
+			}
+
+			_installingFromCache = true;
+
+			if ( beginUpdate(info.imageSize, updatePartition) == false )
+			{
+				_installingFromCache = false;
+				delete [] copyBuffer;
+				return false;
+			}
+
+			uint32_t crc = 0;
+			size_t offset = 0;
+			bool copied = true;
+
+			while ( copied && offset < info.imageSize )
+			{
+				size_t chunkSize = info.imageSize - offset > CACHE_COPY_BUFFER_SIZE ? CACHE_COPY_BUFFER_SIZE : info.imageSize - offset;
+
+				copied = _imageCache->read(entry, offset, copyBuffer, chunkSize) == ESP_OK
+						&& writeFirmwareBytes(copyBuffer, chunkSize) == ESP_OK;
+
+				crc = esp_rom_crc32_le(crc, copyBuffer, chunkSize);
+				offset += chunkSize;
+			}
+
+			delete [] copyBuffer;
+
+			if ( copied == false || crc != info.imageCRC )
+			{
+				ESP_LOGE(LOG_TAG, "Cached image is corrupted! Aborting firmware update...");
+				abortUpdate();
+				return false;
+			}
+
+			ESP_LOGI(LOG_TAG, "Installing cached image %u (%u bytes)", info.sequence, info.imageSize);
+
+			return finishUpdate();
+		}
+
+		void FirmwareUpdater::setResumable(bool resumable)
+		{
+			_sectorMap.setPersistent(resumable);
+		}
+
+		size_t FirmwareUpdater::checkWrittenSectors()
+		{
+			if ( isUpdateRunning() == false || _updateHandle == 0 )
+			{
+				return 0;
+			}
+
+			return _sectorMap.checkSectors(0, _sectorMap.getSectorCount()) * SPI_FLASH_SEC_SIZE;
+		}
+
 		bool FirmwareUpdater::lockUpdate()
 		{
 			MutexLocker locker(__updaterMutex);
@@ -242,6 +506,8 @@ namespace IDFix
 
 			__updateIsRunning = true;
 			_firmwareSize = 0;
+			_writeFailed = false;
+			_sequentialErase = false;
 			return true;
 		}
 
@@ -252,6 +518,20 @@ namespace IDFix
 			__updateIsRunning = false;
 			_updatePartition = nullptr;
 			_updateHandle = 0;
+
+			endStreamHash();
+
+			if ( _cacheWriting )
+			{
+				_imageCache->discard();
+				_cacheWriting = false;
+			}
+
+			_installingFromCache = false;
+
+			// a persisted map stays for resumeUpdate after a reset
+			_sectorMap.end();
+			_resumedUpdate = false;
 		}
 
 		bool FirmwareUpdater::checkFirmware()
@@ -259,15 +539,31 @@ namespace IDFix
 			ESP_LOGI(LOG_TAG, "Update partition start address: %08x", _updatePartition->address );
 			ESP_LOGI(LOG_TAG, "Firmware size: %u bytes", _firmwareSize);
 
-			uint32_t signatureLength = 0;
+			uint32_t signatureField = 0;
 
-			if ( esp_partition_read(_updatePartition, _firmwareSize - sizeof(signatureLength), &signatureLength, sizeof(signatureLength) ) != ESP_OK )
+			if ( _firmwareSize < sizeof(signatureField) + _magicBytesLength )
+			{
+				ESP_LOGE(LOG_TAG, "Firmware too small for the appendix");
+				return false;
+			}
+
+			if ( esp_partition_read(_updatePartition, _firmwareSize - sizeof(signatureField), &signatureField, sizeof(signatureField) ) != ESP_OK )
 			{
 				ESP_LOGE(LOG_TAG, "could not read signature length from flash!");
 				return false;
 			}
 
-			ESP_LOGI(LOG_TAG, "Signature length: %u bytes", signatureLength);
+			uint32_t signatureLength = signatureField & SIGNATURE_LENGTH_MASK;
+			SignatureScheme scheme = static_cast<SignatureScheme>(signatureField >> SIGNATURE_SCHEME_SHIFT);
+
+			ESP_LOGI(LOG_TAG, "Signature length: %u bytes, scheme %u", signatureLength, static_cast<unsigned>(scheme));
+
+			// check the length on its own first, a corrupted length would overflow the appendix size
+			if ( signatureLength > _firmwareSize )
+			{
+				ESP_LOGE(LOG_TAG, "Invalid signature length");
+				return false;
+			}
 
 			size_t appendixSize = signatureLength + _magicBytesLength + sizeof(signatureLength);
 
@@ -287,9 +583,10 @@ namespace IDFix
 				}
 			}
 
+			// cached images are checked as well, anyone able to write the cache partition could forge its flags and CRC
 			if ( signatureUsed() )
 			{
-				if ( checkFirmwareSignature(signatureLength) == false )
+				if ( checkFirmwareSignature(signatureLength, scheme) == false )
 				{
 					ESP_LOGE(LOG_TAG, "Firmware signature check failed!");
 					return false;
@@ -303,7 +600,7 @@ namespace IDFix
 			return true;
 		}
 
-		bool FirmwareUpdater::checkFirmwareSignature(uint32_t signatureLength)
+		bool FirmwareUpdater::checkFirmwareSignature(uint32_t signatureLength, SignatureScheme scheme)
 		{
 
 			if ( signatureLength == 0 )
@@ -311,6 +608,86 @@ namespace IDFix
 				return false;
 			}
 
+			size_t schemeIndex = static_cast<size_t>(scheme);
+
+			if ( schemeIndex >= SCHEME_COUNT || _signatureVerifiers[schemeIndex] == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "no verifier installed for signature scheme %u", static_cast<unsigned>(scheme));
+				return false;
+			}
+
+			SignatureVerifier* verifier = _signatureVerifiers[schemeIndex];
+			HashAlgorithm* hashAlgorithm = _hashAlgorithms[schemeIndex];
+
+			size_t signatureOffset = _firmwareSize - signatureLength - sizeof(signatureLength);
+
+			_verificationReport = VerificationReport();
+			_verificationReport.scheme = scheme;
+			_verificationReport.hashedBytes = signatureOffset;
+
+			int64_t start = esp_timer_get_time();
+
+			if ( hashFirmware(hashAlgorithm, signatureOffset) == false )
+			{
+				return false;
+			}
+
+			_verificationReport.hashUs = esp_timer_get_time() - start;
+
+			unsigned char *signature = new unsigned char[signatureLength];
+
+			if ( signature == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "could not allocate memory for signature");
+				return false;
+			}
+
+			bool signatureValid = false;
+
+			if ( esp_partition_read(_updatePartition, signatureOffset, signature, signatureLength) == ESP_OK )
+			{
+				start = esp_timer_get_time();
+
+				if ( verifier->verify( hashAlgorithm->getHash(), hashAlgorithm->hashLength(), signature, signatureLength) == 0 )
+				{
+					signatureValid = true;
+				}
+
+				_verificationReport.verifyUs = esp_timer_get_time() - start;
+			}
+			else
+			{
+				ESP_LOGE(LOG_TAG, "could not read signature bytes from flash!");
+			}
+
+			delete [] signature;
+
+			ESP_LOGI(LOG_TAG, "Signature scheme %u: hash %lld us (%s), verify %lld us", static_cast<unsigned>(scheme),
+					 static_cast<long long>(_verificationReport.hashUs), _verificationReport.streamed ? "streamed" : "flash",
+					 static_cast<long long>(_verificationReport.verifyUs));
+
+			return signatureValid;
+		}
+
+		bool FirmwareUpdater::hashFirmware(HashAlgorithm *hashAlgorithm, size_t hashLength)
+		{
+			bool streamed = false;
+
+			for ( HashAlgorithm* streamHashAlgorithm : _streamHashAlgorithms )
+			{
+				streamed = streamed || streamHashAlgorithm == hashAlgorithm;
+			}
+
+			// the held back bytes start right after the streamed ones and have to reach the signature
+			if ( streamed && _streamHashValid && _streamedBytes <= hashLength && hashLength - _streamedBytes <= _hashHoldbackLength )
+			{
+				hashAlgorithm->addData(_hashHoldback, hashLength - _streamedBytes);
+				hashAlgorithm->end();
+
+				_verificationReport.streamed = true;
+				return true;
+			}
+
 			unsigned char *readBuffer = new unsigned char[HASH_READ_BUFFER_SIZE];
 
 			if ( readBuffer == nullptr )
@@ -319,68 +696,135 @@ namespace IDFix
 				return false;
 			}
 
-			size_t remaningBytesToHash = _firmwareSize - signatureLength - sizeof(signatureLength);;
+			size_t remaningBytesToHash = hashLength;
 			size_t numberOfBytesHashed  = 0;
 
-			_hashAlgorithm->begin();
+			hashAlgorithm->begin();
 
 			ESP_LOGI(LOG_TAG, "Calculating hash of update");
 
 			while (remaningBytesToHash > 0)
 			{
-				if ( esp_partition_read(_updatePartition, numberOfBytesHashed, readBuffer, HASH_READ_BUFFER_SIZE ) != ESP_OK )
+				// never read past the image, it may end right at the end of the partition
+				size_t chunkSize = remaningBytesToHash > HASH_READ_BUFFER_SIZE ? HASH_READ_BUFFER_SIZE : remaningBytesToHash;
+
+				if ( esp_partition_read(_updatePartition, numberOfBytesHashed, readBuffer, chunkSize ) != ESP_OK )
 				{
 					ESP_LOGE(LOG_TAG, "could not read from flash for hashing");
-					_hashAlgorithm->end();
+					hashAlgorithm->end();
 					delete [] readBuffer;
 					return false;
 				}
 
-				if ( remaningBytesToHash > HASH_READ_BUFFER_SIZE )
+				hashAlgorithm->addData(readBuffer, chunkSize);
+				remaningBytesToHash = remaningBytesToHash - chunkSize;
+				numberOfBytesHashed = numberOfBytesHashed + chunkSize;
+			}
+
+			delete [] readBuffer;
+
+			hashAlgorithm->end();
+
+			return true;
+		}
+
+		void FirmwareUpdater::beginStreamHash()
+		{
+			endStreamHash();
+
+			if ( signatureUsed() == false )
+			{
+				return;
+			}
+
+			_hashHoldback = new unsigned char[HASH_HOLDBACK_SIZE];
+
+			if ( _hashHoldback == nullptr )
+			{
+				ESP_LOGW(LOG_TAG, "could not allocate memory for streamed hashing, hashing from flash");
+				return;
+			}
+
+			size_t count = 0;
+
+			for ( size_t scheme = 0; scheme < SCHEME_COUNT; scheme++ )
+			{
+				HashAlgorithm* hashAlgorithm = _hashAlgorithms[scheme];
+				bool known = hashAlgorithm == nullptr;
+
+				for ( size_t i = 0; i < count; i++ )
 				{
-					_hashAlgorithm->addData(readBuffer, HASH_READ_BUFFER_SIZE);
-					remaningBytesToHash = remaningBytesToHash - HASH_READ_BUFFER_SIZE;
-					numberOfBytesHashed = numberOfBytesHashed + HASH_READ_BUFFER_SIZE;
+					known = known || _streamHashAlgorithms[i] == hashAlgorithm;
 				}
-				else
+
+				if ( known == false )
 				{
-					_hashAlgorithm->addData(readBuffer, remaningBytesToHash);
-					numberOfBytesHashed = numberOfBytesHashed + remaningBytesToHash;
-					remaningBytesToHash = 0;
+					hashAlgorithm->begin();
+					_streamHashAlgorithms[count++] = hashAlgorithm;
 				}
 			}
 
-			delete [] readBuffer;
+			_streamHashValid = true;
+		}
 
-			_hashAlgorithm->end();
+		void FirmwareUpdater::streamHash(const unsigned char *data, size_t size)
+		{
+			if ( _streamHashValid == false )
+			{
+				return;
+			}
 
-			unsigned char *signature = new unsigned char[signatureLength];
+			if ( size >= HASH_HOLDBACK_SIZE )
+			{
+				addStreamHashData(_hashHoldback, _hashHoldbackLength);
+				addStreamHashData(data, size - HASH_HOLDBACK_SIZE);
+				memcpy(_hashHoldback, data + size - HASH_HOLDBACK_SIZE, HASH_HOLDBACK_SIZE);
+				_hashHoldbackLength = HASH_HOLDBACK_SIZE;
+				return;
+			}
 
-			if ( signature == nullptr )
+			if ( _hashHoldbackLength + size > HASH_HOLDBACK_SIZE )
 			{
-				ESP_LOGE(LOG_TAG, "could not allocate memory for signature");
-				return false;
+				size_t overflow = _hashHoldbackLength + size - HASH_HOLDBACK_SIZE;
+				addStreamHashData(_hashHoldback, overflow);
+				memmove(_hashHoldback, _hashHoldback + overflow, _hashHoldbackLength - overflow);
+				_hashHoldbackLength -= overflow;
 			}
 
-			size_t signatureOffset = _firmwareSize - signatureLength - sizeof(signatureLength);
+			memcpy(_hashHoldback + _hashHoldbackLength, data, size);
+			_hashHoldbackLength += size;
+		}
 
-			bool signatureValid = false;
+		void FirmwareUpdater::addStreamHashData(const unsigned char *data, size_t size)
+		{
+			if ( size == 0 )
+			{
+				return;
+			}
 
-			if ( esp_partition_read(_updatePartition, signatureOffset, signature, signatureLength) == ESP_OK )
+			for ( HashAlgorithm* hashAlgorithm : _streamHashAlgorithms )
 			{
-				if ( _signatureVerifier->verify( _hashAlgorithm->getHash(), _hashAlgorithm->hashLength(), signature, signatureLength) == 0 )
+				if ( hashAlgorithm != nullptr )
 				{
-					signatureValid = true;
+					hashAlgorithm->addData(const_cast<unsigned char*>(data), size);
 				}
 			}
-			else
-			{
-				ESP_LOGE(LOG_TAG, "could not read signature bytes from flash!");
-			}
 
-			delete [] signature;
+			_streamedBytes += size;
+		}
 
-			return signatureValid;
+		void FirmwareUpdater::endStreamHash()
+		{
+			delete [] _hashHoldback;
+			_hashHoldback = nullptr;
+			_hashHoldbackLength = 0;
+			_streamedBytes = 0;
+			_streamHashValid = false;
+
+			for ( HashAlgorithm*& hashAlgorithm : _streamHashAlgorithms )
+			{
+				hashAlgorithm = nullptr;
+			}
 		}
 
 		bool FirmwareUpdater::checkMagicBytes(size_t magicBytesOffset)
@@ -402,8 +846,8 @@ namespace IDFix
 
 			if ( esp_partition_read(_updatePartition, magicBytesOffset, magicBytesRead, _magicBytesLength ) == ESP_OK )
 			{
-				ESP_LOGI(LOG_TAG, "Magic bytes read: %.*s",     _magicBytesLength, magicBytesRead);
-				ESP_LOGI(LOG_TAG, "Magic bytes expected: %.*s", _magicBytesLength, _magicBytes);
+				ESP_LOGI(LOG_TAG, "Magic bytes read: %.*s",     static_cast<int>(_magicBytesLength), magicBytesRead);
+				ESP_LOGI(LOG_TAG, "Magic bytes expected: %.*s", static_cast<int>(_magicBytesLength), _magicBytes);
 
 				if ( memcmp(_magicBytes, magicBytesRead, _magicBytesLength) == 0 )
 				{
@@ -25,6 +25,8 @@ extern "C"
 }
 
 #include "IFirmwareWriter.h"
+#include "FirmwareImageCache.h"
+#include "FirmwareSectorMap.h"
 #include "Mutex.h"
 #include "SignatureVerifier.h"
 #include "HashAlgorithm.h"
@@ -35,6 +37,21 @@ namespace IDFix
     {
         using namespace IDFix::Crypto;
 
+        /**
+         * @brief The SignatureScheme enum identifies the verifier used for an image.
+         *
+         * The scheme is stored in the upper 8 bits of the 32 bit signature length at the end of the image,
+         * images without a scheme (0) are checked with the verifier installed without a scheme.
+         */
+        enum class SignatureScheme : uint8_t
+        {
+            Default     = 0,
+            RSA         = 1,
+            ECDSA_P256  = 2,
+            Ed25519ph   = 3,
+            Count
+        };
+
         /**
          * @brief The FirmwareUpdater class provides methods to write a firmware update to the flash.
          *
@@ -50,13 +67,35 @@ namespace IDFix
                 /**
                  * @brief                   Start an update transaction
                  *
-                 * @param imageSize         Optional size of the new firmware or OTA_SIZE_UNKNOWN - affects the portion of the partition that will be erased. By default the entire partition is erased.
+                 * The erase of the partition blocks the calling task and keeps the flash busy for seconds, a throttled
+                 * FirmwareTransfer can not spread it. With OTA_WITH_SEQUENTIAL_WRITES nothing is erased here, each sector is
+                 * erased by writeFirmwareBytes when it is reached, so the erase time is throttled along with the writes.
+                 * writeFirmwareBytesAt is not available in that mode.
+                 *
+                 * @param imageSize         Optional size of the new firmware, OTA_SIZE_UNKNOWN or OTA_WITH_SEQUENTIAL_WRITES - affects the portion of the partition that will be erased. By default the entire partition is erased.
                  * @param updatePartition   Optional pointer to partition information used for the update
                  *
                  * @return                  \c true if update transaction was started, otherwise \c false
                  */
                 bool                        beginUpdate(size_t imageSize = OTA_SIZE_UNKNOWN, const esp_partition_t *updatePartition = nullptr);
 
+                /**
+                 * @brief                   Resume an update transaction interrupted by a reset or power loss
+                 *
+                 * Requires setResumable(true) for the interrupted transaction. Only the sectors recorded in the
+                 * sector map are re-read, the update continues after the last intact one. The caller has to make
+                 * sure the same image is resumed and continue its download at resumeOffset, e.g. with
+                 * FirmwareTransfer::setSourceOffset(). With flash encryption all following writes have to be
+                 * multiples of 16 bytes.
+                 *
+                 * @param imageSize         the image size passed to beginUpdate for the interrupted transaction
+                 * @param resumeOffset      returns the image offset the update continues at
+                 * @param updatePartition   Optional pointer to partition information used for the update
+                 *
+                 * @return                  \c true if update transaction was resumed, otherwise \c false
+                 */
+                bool                        resumeUpdate(size_t imageSize, size_t* resumeOffset, const esp_partition_t *updatePartition = nullptr);
+
                 /**
                  * \brief               Write OTA firmware bytes continuously to flash
                  *
@@ -71,6 +110,23 @@ namespace IDFix
                  */
 				esp_err_t               writeFirmwareBytes(const void* data, size_t size) override;
 
+                /**
+                 * \brief               Write OTA firmware bytes at an arbitrary offset
+                 *
+                 * The written range has to be erased, so the transaction has to be started with the
+                 * image size (or OTA_SIZE_UNKNOWN) to erase it in beginUpdate, not with OTA_WITH_SEQUENTIAL_WRITES.
+                 * With flash encryption offset and size have to be multiples of 16 bytes.
+                 *
+                 * \param offset        Offset of the data in the firmware image
+                 * \param data          Data buffer to write
+                 * \param size          Size of data buffer in bytes.
+                 *
+                 * \return              ESP_OK on success
+                 * \return              ESP_ERR_INVALID_STATE if the transaction erases sectors as they are written
+                 * \return              the error code from IDF esp_ota_write_with_offset
+                 */
+				esp_err_t               writeFirmwareBytesAt(size_t offset, const void* data, size_t size) override;
+
                 /**
                  * @brief               Finish the update transaction and check the updated firmware
                  *
@@ -127,6 +183,78 @@ namespace IDFix
                  */
                 bool                    installSignatureVerifier(SignatureVerifier *verifier, HashAlgorithm *hashAlgo);
 
+                /**
+                 * @brief               Install a SignatureVerifier for images signed with a specific scheme
+                 *
+                 * Several schemes can be installed at the same time, e.g. to migrate from RSA-2048 to ECDSA P-256 for
+                 * smaller keys and signatures (72 instead of 256 bytes). Verifying P-256 is slower than verifying RSA,
+                 * see test/SignatureBenchmark.cpp. Verifiers and hash algorithms have to be installed before beginUpdate.
+                 *
+                 * @param scheme        the scheme identifier the images carry
+                 * @param verifier      pointer to the SignatureVerifier object
+                 * @param hashAlgo      pointer to the HashAlgorithm the scheme signs, e.g. SHA-512 for Ed25519ph
+                 *
+                 * @return              true if verifier was successfully installed, otherwise \c false
+                 */
+                bool                    installSignatureVerifier(SignatureScheme scheme, SignatureVerifier *verifier, HashAlgorithm *hashAlgo);
+
+                /**
+                 * @brief The VerificationReport struct describes the cost of the last signature check.
+                 */
+                struct VerificationReport
+                {
+                    SignatureScheme     scheme = { SignatureScheme::Default };
+                    bool                streamed = { false };   ///< hash was calculated while writing, no flash re-read
+                    uint32_t            hashedBytes = { 0 };
+                    int64_t             hashUs = { 0 };         ///< time spent in finishUpdate for hashing
+                    int64_t             verifyUs = { 0 };       ///< time spent in SignatureVerifier::verify
+                };
+
+                /**
+                 * @brief               Get the cost report of the last signature check
+                 */
+                const VerificationReport&   getVerificationReport() const;
+
+                /**
+                 * @brief               Persist the per sector CRC map of updates so they can be resumed with resumeUpdate
+                 *
+                 * nvs_flash has to be initialized by the application.
+                 */
+                void                    setResumable(bool resumable);
+
+                /**
+                 * @brief               Re-check the sectors written so far in the running transaction against their CRC
+                 *
+                 * The CRCs are only recorded with setResumable(true).
+                 *
+                 * @return              length of the intact part of the image in bytes, a multiple of the sector size
+                 */
+                size_t                  checkWrittenSectors();
+
+                /**
+                 * @brief               Keep a copy of every written image in an image cache
+                 *
+                 * The image is copied to the cache while it is written and committed once it passed the check
+                 * in finishUpdate. Caching failures never fail the update itself.
+                 *
+                 * @param cache         pointer to the cache or nullptr to disable caching
+                 */
+                void                    setImageCache(FirmwareImageCache* cache);
+
+                /**
+                 * @brief               Install a cached image without downloading it again
+                 *
+                 * The image is copied from the cache partition and checked against the CRC of the cache entry. The
+                 * signature is checked like on any other update, with the verifiers installed now, so a rotated key
+                 * or a tampered cache partition cannot bring back an image that would not pass today.
+                 *
+                 * @param entry             the latest image, or the previous one for a rollback
+                 * @param updatePartition   Optional pointer to partition information used for the update
+                 *
+                 * @return              true if the image was installed and set as boot partition
+                 */
+                bool                    installFromCache(FirmwareImageCache::Entry entry = FirmwareImageCache::Entry::Latest, const esp_partition_t *updatePartition = nullptr);
+
             protected:
 
 				static bool             __updateIsRunning;
@@ -161,10 +289,37 @@ namespace IDFix
                  * @brief               Check the signature of the firmware image
                  *
                  * @param signatureLength   the length of the actual signature in bytes
+                 * @param scheme            the signature scheme of the image
                  *
                  * @return              true if firmware signature is ok, otherwise false
                  */
-				bool                    checkFirmwareSignature(uint32_t signatureLength);
+				bool                    checkFirmwareSignature(uint32_t signatureLength, SignatureScheme scheme);
+
+                /**
+                 * @brief               Hash the signed part of the image, from the streamed hash if possible, otherwise from flash
+                 *
+                 * @param hashAlgorithm     the hash algorithm of the scheme
+                 * @param hashLength        number of bytes covered by the signature
+                 *
+                 * @return              true on success, otherwise false
+                 */
+				bool                    hashFirmware(HashAlgorithm* hashAlgorithm, size_t hashLength);
+
+                /**
+                 * @brief               Start hashing the firmware with all installed hash algorithms while it is written
+                 */
+				void                    beginStreamHash();
+
+                /**
+                 * @brief               Feed written firmware to the streamed hash
+                 *
+                 * The last bytes are held back, as the signature at the end of the image must not be hashed
+                 * and its length is only known once the image is complete.
+                 */
+				void                    streamHash(const unsigned char* data, size_t size);
+
+				void                    addStreamHashData(const unsigned char* data, size_t size);
+				void                    endStreamHash();
 
                 /**
                  * @brief               Check if the firmware image contains the correct magic bytes
@@ -187,13 +342,32 @@ namespace IDFix
                  *
                  * @return              true if firmware signature was configured to be used, otherwise false
                  */
-				inline bool				signatureUsed() { return _signatureVerifier != nullptr; }
+				inline bool				signatureUsed() { return _installedSchemes != 0; }
 
                 esp_ota_handle_t        _updateHandle = { 0 } ;
                 const esp_partition_t*  _updatePartition = { nullptr };
                 uint32_t                _firmwareSize = { 0 };
-                SignatureVerifier*      _signatureVerifier = { nullptr };
-                HashAlgorithm*          _hashAlgorithm = { nullptr };
+                bool                    _writeFailed = { false };
+                bool                    _sequentialErase = { false };
+                static const size_t     SCHEME_COUNT = static_cast<size_t>(SignatureScheme::Count);
+
+                SignatureVerifier*      _signatureVerifiers[SCHEME_COUNT] = { nullptr };
+                HashAlgorithm*          _hashAlgorithms[SCHEME_COUNT] = { nullptr };
+                uint32_t                _installedSchemes = { 0 };
+
+                HashAlgorithm*          _streamHashAlgorithms[SCHEME_COUNT] = { nullptr };
+                unsigned char*          _hashHoldback = { nullptr };
+                size_t                  _hashHoldbackLength = { 0 };
+                uint32_t                _streamedBytes = { 0 };
+                bool                    _streamHashValid = { false };
+                VerificationReport      _verificationReport;
+
+                FirmwareImageCache*     _imageCache = { nullptr };
+                bool                    _cacheWriting = { false };
+                bool                    _installingFromCache = { false };
+
+                FirmwareSectorMap       _sectorMap;
+                bool                    _resumedUpdate = { false };
 
 				char*                   _magicBytes = {nullptr};
 				size_t                  _magicBytesLength = { 0 };
@@ -16,18 +16,6 @@
  */
 
 #include "HTTPFirmwareDownloader.h"
-#include "IFirmwareWriter.h"
-
-extern "C"
-{
-	#include <esp_log.h>
-}
-
-namespace
-{
-	const char*		LOG_TAG						= "IDFix::HTTPFirmwareDownloader";
-	const size_t	HTTP_RECEIVE_BUFFER_SIZE	= 1024;
-}
 
 namespace IDFix
 {
@@ -35,83 +23,43 @@ namespace IDFix
 	{
 		HTTPFirmwareDownloader::HTTPFirmwareDownloader()
 		{
-
+			setFirmwareSource(&_httpSource);
 		}
 
-		void HTTPFirmwareDownloader::setFirmwareWriter(IFirmwareWriter *writer)
+		HTTPFirmwareDownloader::~HTTPFirmwareDownloader()
 		{
-			_firmwareWriter = writer;
+			// the source is destroyed before the FirmwareTransfer destructor runs
+			closeOpenTransfer();
 		}
 
 		int HTTPFirmwareDownloader::downloadFirmware(esp_http_client_config_t *httpConfig)
 		{
-			if ( _firmwareWriter == nullptr )
-			{
-				ESP_LOGE(LOG_TAG, "Download error: no firmware writer set!");
-				return -1;
-			}
-
-			_httpClient = esp_http_client_init(httpConfig);
+			_httpSource.setHTTPConfig(httpConfig);
+			return transferFirmware();
+		}
 
-			esp_err_t errorCode;
+		bool HTTPFirmwareDownloader::beginDownload(esp_http_client_config_t *httpConfig, FinishedCallback onFinished)
+		{
+			_httpSource.setHTTPConfig(httpConfig);
+			return beginTransfer(onFinished);
+		}
 
-			if ( (errorCode = esp_http_client_open(_httpClient, 0) ) != ESP_OK )
+		bool HTTPFirmwareDownloader::startBackgroundDownload(const esp_http_client_config_t &httpConfig, UBaseType_t priority, BaseType_t coreID, FinishedCallback onFinished,
+															 uint32_t stackSize)
+		{
+			if ( isBackgroundTransferRunning() )
 			{
-				ESP_LOGE(LOG_TAG, "Failed to open HTTP connection: %d", errorCode);
-				return -1;
+				return false;
 			}
 
-			int contentLength =  esp_http_client_fetch_headers(_httpClient);
-			ESP_LOGI(LOG_TAG, "Content length: %d", contentLength);
-
-
-			char *readBuffer = new char[HTTP_RECEIVE_BUFFER_SIZE];
-
-				if ( readBuffer == nullptr )
-				{
-					ESP_LOGE(LOG_TAG, "could not allocate memory for http read buffer");
-					return -1;
-				}
-
-				int totalReadBytes = 0;
-				int currentReadBytes = 0;
-				bool downloadSuccessful = true;
-
-				do
-				{
-					currentReadBytes = esp_http_client_read(_httpClient, readBuffer, HTTP_RECEIVE_BUFFER_SIZE);
-
-					if ( currentReadBytes >= 0)
-					{
-						totalReadBytes = totalReadBytes + currentReadBytes;
-
-						ESP_LOGI(LOG_TAG, "[*] %.*f %% | Downloaded %d from %d Bytes", 2, (100.0f / contentLength) * totalReadBytes, totalReadBytes, contentLength );
-						if ( (errorCode = _firmwareWriter->writeFirmwareBytes(readBuffer, currentReadBytes) ) != ESP_OK )
-						{
-							ESP_LOGE(LOG_TAG, "failed writeFirmwareBytes with result %s", esp_err_to_name(errorCode) );
-							downloadSuccessful = false;
-							break;
-						}
-
-					}
-					else
-					{
-						ESP_LOGE(LOG_TAG, "could not read from http stream...");
-						downloadSuccessful = false;
-						break;
-					}
-
-				}
-				while ( totalReadBytes < contentLength );
-
-			delete [] readBuffer;
-
-			if ( downloadSuccessful == false )
-			{
-				return -1;
-			}
+			_backgroundConfig = httpConfig;
+			_httpSource.setHTTPConfig(&_backgroundConfig);
+			return startBackgroundTransfer(priority, coreID, onFinished, stackSize);
+		}
 
-			return 0;
+		bool HTTPFirmwareDownloader::isBackgroundDownloadRunning() const
+		{
+			return isBackgroundTransferRunning();
 		}
 
 	}
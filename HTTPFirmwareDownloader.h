@@ -18,6 +18,9 @@
 #ifndef HTTPFIRMWAREDOWNLOADER_H
 #define HTTPFIRMWAREDOWNLOADER_H
 
+#include "FirmwareTransfer.h"
+#include "HTTPFirmwareSource.h"
+
 extern "C"
 {
 	#include "esp_http_client.h"
@@ -27,24 +30,18 @@ namespace IDFix
 {
 	namespace FOTA
 	{
-		class IFirmwareWriter;
-
         /**
          * @brief The HTTPFirmwareDownloader class provides a possibility to download a firmware image via HTTP.
          *
          * The downloaded firmware will be written via a IFirmwareWriter to an approrpiate location.
+         * Throttling, read buffer sizing and the step driven API are inherited from FirmwareTransfer.
          */
-		class HTTPFirmwareDownloader
+		class HTTPFirmwareDownloader : public FirmwareTransfer
 		{
 			public:
 
 									HTTPFirmwareDownloader();
-
-                /**
-                 * @brief           Set the IFirmwareWriter used to write the downloaded firmware
-                 * @param writer    the IFirmwareWriter used to write the firmware
-                 */
-				void				setFirmwareWriter(IFirmwareWriter* writer);
+				virtual				~HTTPFirmwareDownloader();
 
                 /**
                  * @brief           Start the firmware download from HTTP
@@ -56,10 +53,44 @@ namespace IDFix
                  */
 				int					downloadFirmware(esp_http_client_config_t *httpConfig);
 
+                /**
+                 * @brief           Open the HTTP connection for a step driven download
+                 *
+                 * @param httpConfig    the IDF http configuration to be used, has to stay valid until the download is finished
+                 * @param onFinished    optional callback, called with the downloadFirmware() compatible result
+                 *                      when the download finished, failed or was cancelled
+                 *
+                 * @return          \c true if the connection was opened and step() can be called, otherwise \c false
+                 */
+				bool				beginDownload(esp_http_client_config_t *httpConfig, FinishedCallback onFinished = nullptr);
+
+                /**
+                 * @brief           Start the firmware download in a separate FreeRTOS task
+                 *
+                 * The configuration is copied, but all strings referenced by it (url, certificates...) have to stay
+                 * valid until the download is finished.
+                 *
+                 * @param httpConfig    the IDF http configuration to be used
+                 * @param priority      priority of the download task, should be below the time critical tasks
+                 * @param coreID        core the download task is pinned to or \c tskNO_AFFINITY
+                 * @param onFinished    optional callback, called from the download task with the downloadFirmware result
+                 * @param stackSize     stack size of the download task in bytes, TLS needs more than plain HTTP
+                 *
+                 * @return          \c true if the download task was started, otherwise \c false
+                 */
+				bool				startBackgroundDownload(const esp_http_client_config_t& httpConfig, UBaseType_t priority,
+															BaseType_t coreID = tskNO_AFFINITY, FinishedCallback onFinished = nullptr,
+															uint32_t stackSize = DEFAULT_BACKGROUND_STACK_SIZE);
+
+                /**
+                 * @brief           Check if a download started with startBackgroundDownload is still running
+                 */
+				bool				isBackgroundDownloadRunning() const;
+
 			private:
 
-				IFirmwareWriter*			_firmwareWriter = { nullptr };
-				esp_http_client_handle_t	_httpClient = { nullptr };
+				HTTPFirmwareSource			_httpSource;
+				esp_http_client_config_t	_backgroundConfig = {};
 		};
 	}
 }
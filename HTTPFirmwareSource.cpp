@@ -0,0 +1,135 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HTTPFirmwareSource.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <stdio.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::HTTPFirmwareSource";
+	const int		HTTP_STATUS_OK				= 200;
+	const int		HTTP_STATUS_PARTIAL_CONTENT	= 206;
+	const int		HTTP_RX_BUFFER_SIZE			= 4096;		// esp_http_client reads the transport in chunks of this size, IDF default is 512
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		HTTPFirmwareSource::HTTPFirmwareSource()
+		{
+
+		}
+
+		void HTTPFirmwareSource::setHTTPConfig(esp_http_client_config_t *httpConfig)
+		{
+			_httpConfig = httpConfig;
+		}
+
+		bool HTTPFirmwareSource::open(size_t offset)
+		{
+			if ( _httpConfig == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "no http configuration set!");
+				return false;
+			}
+
+			// the client copies the configuration, so the buffer size can be raised without touching the caller's copy
+			esp_http_client_config_t config = *_httpConfig;
+
+			if ( config.buffer_size < HTTP_RX_BUFFER_SIZE )
+			{
+				config.buffer_size = HTTP_RX_BUFFER_SIZE;
+			}
+
+			_httpClient = esp_http_client_init(&config);
+
+			if ( _httpClient == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "Failed to initialize HTTP client");
+				return false;
+			}
+
+			if ( offset > 0 )
+			{
+				char range[32];
+				snprintf(range, sizeof(range), "bytes=%u-", static_cast<unsigned>(offset));
+				esp_http_client_set_header(_httpClient, "Range", range);
+			}
+
+			esp_err_t errorCode;
+
+			if ( (errorCode = esp_http_client_open(_httpClient, 0) ) != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "Failed to open HTTP connection: %d", errorCode);
+				esp_http_client_cleanup(_httpClient);
+				_httpClient = nullptr;
+				return false;
+			}
+
+			_contentLength =  esp_http_client_fetch_headers(_httpClient);
+
+			int statusCode = esp_http_client_get_status_code(_httpClient);
+			if ( statusCode != (offset > 0 ? HTTP_STATUS_PARTIAL_CONTENT : HTTP_STATUS_OK) )
+			{
+				// never write an error page to the update partition, nor the start of the image at the offset
+				// when the server ignored the range request
+				ESP_LOGE(LOG_TAG, "Unexpected HTTP status code: %d", statusCode);
+				close();
+				return false;
+			}
+
+			return true;
+		}
+
+		void HTTPFirmwareSource::close()
+		{
+			if ( _httpClient != nullptr )
+			{
+				esp_http_client_close(_httpClient);
+				esp_http_client_cleanup(_httpClient);
+				_httpClient = nullptr;
+			}
+		}
+
+		int HTTPFirmwareSource::contentLength() const
+		{
+			return _contentLength;
+		}
+
+		int HTTPFirmwareSource::read(void *buffer, size_t size)
+		{
+			return esp_http_client_read(_httpClient, static_cast<char*>(buffer), size);
+		}
+
+		bool HTTPFirmwareSource::isComplete()
+		{
+			return esp_http_client_is_complete_data_received(_httpClient);
+		}
+
+		size_t HTTPFirmwareSource::preferredReadSize() const
+		{
+			return HTTP_RX_BUFFER_SIZE;
+		}
+
+	}
+}
@@ -0,0 +1,67 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HTTPFIRMWARESOURCE_H
+#define HTTPFIRMWARESOURCE_H
+
+#include "IFirmwareSource.h"
+
+extern "C"
+{
+	#include "esp_http_client.h"
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The HTTPFirmwareSource class reads a firmware image via the IDF http client.
+         *
+         * The receive buffer of the client is raised to at least 4 KiB, the IDF default of 512 bytes
+         * costs one transport read per 512 bytes of the image. An offset is requested with a Range header,
+         * servers without support for range requests fail to open at an offset.
+         */
+		class HTTPFirmwareSource : public IFirmwareSource
+		{
+			public:
+
+									HTTPFirmwareSource();
+
+                /**
+                 * @brief           Set the http configuration used by the next open()
+                 * @param httpConfig    the IDF http configuration, has to stay valid until the source is closed
+                 */
+				void				setHTTPConfig(esp_http_client_config_t* httpConfig);
+
+				bool				open(size_t offset) override;
+				void				close() override;
+				int					contentLength() const override;
+				int					read(void* buffer, size_t size) override;
+				bool				isComplete() override;
+				size_t				preferredReadSize() const override;
+
+			private:
+
+				esp_http_client_config_t*	_httpConfig = { nullptr };
+				esp_http_client_handle_t	_httpClient = { nullptr };
+				int							_contentLength = { 0 };
+		};
+	}
+}
+
+#endif // HTTPFIRMWARESOURCE_H
@@ -0,0 +1,100 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IFIRMWARESOURCE_H
+#define IFIRMWARESOURCE_H
+
+#include <stddef.h>
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The IFirmwareSource class provides an interface abstraction for the origin of a firmware image.
+         *
+         * A FirmwareTransfer reads the image from a source and passes it to an IFirmwareWriter.
+         */
+		class IFirmwareSource
+		{
+			public:
+
+				virtual				~IFirmwareSource() {}
+
+                /**
+                 * @brief           Open the source for reading
+                 *
+                 * A source that cannot start at \c offset has to fail instead of delivering the image from its start.
+                 *
+                 * @param offset    image offset to start at, e.g. to continue an update resumed by FirmwareUpdater
+                 * @return          \c true on success, otherwise \c false
+                 */
+				virtual bool		open(size_t offset) = 0;
+
+                /**
+                 * @brief           Close the source and release all resources, may be called on a closed source
+                 */
+				virtual void		close() = 0;
+
+                /**
+                 * @brief           Get the size of the image from the offset passed to open() on
+                 * @return          the size in bytes, \c 0 or less if the size is not known in advance
+                 */
+				virtual int			contentLength() const = 0;
+
+                /**
+                 * @brief           Copy the next bytes of the image into a buffer
+                 *
+                 * @param buffer    the buffer to read into
+                 * @param size      the maximum number of bytes to read
+                 *
+                 * @return          the number of bytes read, \c 0 if no data is available at the moment
+                 * @return          \c -1 on error
+                 */
+				virtual int			read(void* buffer, size_t size) = 0;
+
+                /**
+                 * @brief           Check if the end of the image was reached
+                 */
+				virtual bool		isComplete() = 0;
+
+                /**
+                 * @brief           Read size the source works best with, \c 0 if the source has no preference
+                 */
+				virtual size_t		preferredReadSize() const { return 0; }
+
+                /**
+                 * @brief           Check if the source supports readDirect()
+                 */
+				virtual bool		supportsDirectRead() const { return false; }
+
+                /**
+                 * @brief           Get a pointer to the next bytes of the image without copying them
+                 *
+                 * The data stays valid until the next call to readDirect() or close().
+                 *
+                 * @param data      set to the start of the data
+                 * @param size      the maximum number of bytes to return
+                 *
+                 * @return          the number of bytes available at \c data, \c 0 at the end of the image, \c -1 on error
+                 */
+				virtual int			readDirect(const void** data, size_t size) { (void)data; (void)size; return -1; }
+		};
+	}
+}
+
+#endif // IFIRMWARESOURCE_H
@@ -21,6 +21,7 @@
 extern "C"
 {
 	#include "esp_err.h"
+	#include <stddef.h>
 }
 
 namespace IDFix
@@ -50,6 +51,21 @@ namespace IDFix
                  * \return          the error code from IDF get_ota_partition_count
                  */
 				virtual esp_err_t	writeFirmwareBytes(const void* data, size_t size) = 0;
+
+                /**
+                 * \brief           Write OTA firmware bytes at an arbitrary offset
+                 *
+                 * Used by sources that receive the firmware out of order. Writers which can only
+                 * write sequentially do not need to implement it.
+                 *
+                 * \param offset    Offset of the data in the firmware image
+                 * \param data      Data buffer to write
+                 * \param size      Size of data buffer in bytes.
+                 *
+                 * \return          ESP_OK on success
+                 * \return          ESP_ERR_NOT_SUPPORTED if the writer can only write sequentially
+                 */
+				virtual esp_err_t	writeFirmwareBytesAt(size_t offset, const void* data, size_t size) { (void)offset; (void)data; (void)size; return ESP_ERR_NOT_SUPPORTED; }
 		};
 	}
 }
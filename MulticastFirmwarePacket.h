@@ -0,0 +1,123 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTICASTFIRMWAREPACKET_H
+#define MULTICASTFIRMWAREPACKET_H
+
+extern "C"
+{
+	#include <stdint.h>
+	#include <stddef.h>
+	#include <arpa/inet.h>
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		namespace Multicast
+		{
+			const uint32_t	PACKET_MAGIC		= 0x49444658;	// "IDFX"
+			const uint8_t	PROTOCOL_VERSION	= 1;
+			const uint16_t	MIN_CHUNK_SIZE		= 256;			// bounds the chunk bitmap a receiver allocates for an image
+			const uint16_t	DEFAULT_CHUNK_SIZE	= 1024;
+			const uint16_t	MAX_CHUNK_SIZE		= 1408;
+			const uint8_t	DEFAULT_GROUP_SIZE	= 16;
+			const uint8_t	MAX_GROUP_SIZE		= 32;
+
+			enum class PacketType : uint8_t
+			{
+				Data			= 0,	///< index is the chunk index, payload is the chunk
+				Parity			= 1,	///< index is the FEC group, payload is the XOR of all (zero padded) chunks of the group
+				RepairRequest	= 2		///< index is the missing chunk, sent unicast from a receiver to the seeder
+			};
+
+            /**
+             * @brief The PacketHeader struct precedes every packet, all fields are sent in network byte order.
+             *
+             * The image is split into chunks of \c chunkSize bytes (the last one may be shorter), \c groupSize
+             * consecutive chunks form a FEC group protected by one parity packet.
+             */
+			struct __attribute__((packed)) PacketHeader
+			{
+				uint32_t	magic;
+				uint8_t		version;
+				uint8_t		type;
+				uint8_t		groupSize;
+				uint8_t		reserved;
+				uint16_t	chunkSize;
+				uint16_t	reserved2;
+				uint32_t	sessionID;
+				uint32_t	imageSize;
+				uint32_t	index;
+			};
+
+			const size_t	MAX_PACKET_SIZE		= sizeof(PacketHeader) + MAX_CHUNK_SIZE;
+
+            /**
+             * @brief           Number of chunks of an image, without the overflow of rounding up near 4 GiB
+             */
+			inline uint32_t chunkCount(uint32_t imageSize, uint16_t chunkSize)
+			{
+				return imageSize / chunkSize + (imageSize % chunkSize != 0 ? 1 : 0);
+			}
+
+			inline void encodeHeader(PacketHeader* header, PacketType type, uint8_t groupSize, uint16_t chunkSize, uint32_t sessionID, uint32_t imageSize, uint32_t index)
+			{
+				header->magic = htonl(PACKET_MAGIC);
+				header->version = PROTOCOL_VERSION;
+				header->type = static_cast<uint8_t>(type);
+				header->groupSize = groupSize;
+				header->reserved = 0;
+				header->chunkSize = htons(chunkSize);
+				header->reserved2 = 0;
+				header->sessionID = htonl(sessionID);
+				header->imageSize = htonl(imageSize);
+				header->index = htonl(index);
+			}
+
+            /**
+             * @brief           Convert a received header to host byte order and validate it
+             * @return          \c true if the header belongs to this protocol, otherwise \c false
+             */
+			inline bool decodeHeader(const void* packet, size_t packetSize, PacketHeader* header)
+			{
+				if ( packetSize < sizeof(PacketHeader) )
+				{
+					return false;
+				}
+
+				const PacketHeader* raw = static_cast<const PacketHeader*>(packet);
+
+				header->magic = ntohl(raw->magic);
+				header->version = raw->version;
+				header->type = raw->type;
+				header->groupSize = raw->groupSize;
+				header->chunkSize = ntohs(raw->chunkSize);
+				header->sessionID = ntohl(raw->sessionID);
+				header->imageSize = ntohl(raw->imageSize);
+				header->index = ntohl(raw->index);
+
+				return header->magic == PACKET_MAGIC && header->version == PROTOCOL_VERSION
+						&& header->chunkSize >= MIN_CHUNK_SIZE && header->chunkSize <= MAX_CHUNK_SIZE
+						&& header->groupSize > 0 && header->groupSize <= MAX_GROUP_SIZE;
+			}
+		}
+	}
+}
+
+#endif // MULTICASTFIRMWAREPACKET_H
@@ -0,0 +1,524 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MulticastFirmwareReceiver.h"
+#include "IFirmwareWriter.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_timer.h>
+	#include <errno.h>
+	#include <string.h>
+	#include <unistd.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+	#include <arpa/inet.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::MulticastFirmwareReceiver";
+	const uint32_t	RECEIVE_INTERVAL_MS			= 200;
+	const int64_t	RECEIVE_INTERVAL_US			= RECEIVE_INTERVAL_MS * 1000;
+	const uint32_t	MAX_REPAIR_REQUESTS			= 16;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		using namespace Multicast;
+
+		MulticastFirmwareReceiver::MulticastFirmwareReceiver()
+		{
+
+		}
+
+		MulticastFirmwareReceiver::~MulticastFirmwareReceiver()
+		{
+			end();
+		}
+
+		bool MulticastFirmwareReceiver::begin(const char *groupAddress, uint16_t port, uint32_t maxImageSize, const char *interfaceAddress)
+		{
+			end();
+
+			_maxImageSize = maxImageSize;
+
+			if ( inet_aton(groupAddress, &_membership.imr_multiaddr) == 0 )
+			{
+				ESP_LOGE(LOG_TAG, "invalid multicast group address %s", groupAddress);
+				return false;
+			}
+
+			_membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+			if ( interfaceAddress != nullptr && inet_aton(interfaceAddress, &_membership.imr_interface) == 0 )
+			{
+				ESP_LOGE(LOG_TAG, "invalid interface address %s", interfaceAddress);
+				return false;
+			}
+
+			_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+			if ( _socket < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not create socket: %d", errno);
+				return false;
+			}
+
+			int reuse = 1;
+			setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+			sockaddr_in localAddress = {};
+			localAddress.sin_family = AF_INET;
+			localAddress.sin_port = htons(port);
+			localAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+
+			if ( bind(_socket, reinterpret_cast<sockaddr*>(&localAddress), sizeof(localAddress)) < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not bind to port %u: %d", port, errno);
+				end();
+				return false;
+			}
+
+			if ( setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &_membership, sizeof(_membership)) < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not join multicast group %s: %d", groupAddress, errno);
+				end();
+				return false;
+			}
+
+			struct timeval timeout;
+			timeout.tv_sec = RECEIVE_INTERVAL_MS / 1000;
+			timeout.tv_usec = (RECEIVE_INTERVAL_MS % 1000) * 1000;
+			setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+			return true;
+		}
+
+		void MulticastFirmwareReceiver::end()
+		{
+			if ( _socket >= 0 )
+			{
+				setsockopt(_socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, &_membership, sizeof(_membership));
+				close(_socket);
+				_socket = -1;
+			}
+
+			_sessionKnown = false;
+			_seederKnown = false;
+			_storing = false;
+			_receivedChunks.clear();
+			_receivedCount = 0;
+
+			for ( GroupAccumulator& accumulator : _accumulators )
+			{
+				accumulator.used = false;
+				accumulator.data.clear();
+				accumulator.data.shrink_to_fit();
+			}
+		}
+
+		void MulticastFirmwareReceiver::setFirmwareWriter(IFirmwareWriter *writer)
+		{
+			_firmwareWriter = writer;
+		}
+
+		bool MulticastFirmwareReceiver::waitForSession(uint32_t timeoutMs)
+		{
+			if ( _socket < 0 )
+			{
+				return false;
+			}
+
+			int64_t start = esp_timer_get_time();
+
+			while ( _sessionKnown == false )
+			{
+				if ( receivePacket() == ReceiveResult::Error )
+				{
+					return false;
+				}
+
+				if ( _sessionKnown == false && esp_timer_get_time() - start >= static_cast<int64_t>(timeoutMs) * 1000 )
+				{
+					return false;
+				}
+			}
+
+			ESP_LOGI(LOG_TAG, "Joined session %08x: %u bytes in %u chunks", _sessionID, _imageSize, chunkCount());
+			return true;
+		}
+
+		uint32_t MulticastFirmwareReceiver::getImageSize() const
+		{
+			return _imageSize;
+		}
+
+		uint32_t MulticastFirmwareReceiver::getSessionID() const
+		{
+			return _sessionID;
+		}
+
+		int MulticastFirmwareReceiver::receiveFirmware(uint32_t idleTimeoutMs)
+		{
+			if ( _firmwareWriter == nullptr )
+			{
+				ESP_LOGE(LOG_TAG, "Receive error: no firmware writer set!");
+				return -1;
+			}
+
+			if ( _sessionKnown == false && waitForSession(idleTimeoutMs) == false )
+			{
+				ESP_LOGE(LOG_TAG, "Receive error: no seeder found");
+				return -1;
+			}
+
+			_storing = true;
+			_writeFailed = false;
+
+			int64_t idleTimeoutUs = static_cast<int64_t>(idleTimeoutMs) * 1000;
+			int64_t lastPacketTimestamp = esp_timer_get_time();
+			int64_t lastRepairTimestamp = lastPacketTimestamp;
+
+			while ( isComplete() == false )
+			{
+				ReceiveResult result = receivePacket();
+
+				if ( result == ReceiveResult::Error || _writeFailed )
+				{
+					_storing = false;
+					return -1;
+				}
+
+				int64_t now = esp_timer_get_time();
+
+				if ( result == ReceiveResult::Handled )
+				{
+					lastPacketTimestamp = now;
+					continue;
+				}
+
+				if ( now - lastPacketTimestamp >= idleTimeoutUs )
+				{
+					ESP_LOGE(LOG_TAG, "Receive timeout with %u from %u chunks", _receivedCount, chunkCount());
+					_storing = false;
+					return -1;
+				}
+
+				// the broadcast paused, ask the seeder directly for what is still missing
+				if ( now - lastPacketTimestamp >= RECEIVE_INTERVAL_US && now - lastRepairTimestamp >= RECEIVE_INTERVAL_US )
+				{
+					requestRepairs();
+					lastRepairTimestamp = now;
+				}
+			}
+
+			_storing = false;
+
+			ESP_LOGI(LOG_TAG, "Received %u chunks: %u received, %u recovered from parity, %u duplicates, %u repair requests",
+					 chunkCount(), _stats.receivedChunks, _stats.recoveredChunks, _stats.duplicateChunks, _stats.repairRequests);
+
+			return 0;
+		}
+
+		bool MulticastFirmwareReceiver::isComplete() const
+		{
+			return _sessionKnown && _receivedCount == chunkCount();
+		}
+
+		const MulticastFirmwareReceiver::Stats &MulticastFirmwareReceiver::getStats() const
+		{
+			return _stats;
+		}
+
+		MulticastFirmwareReceiver::ReceiveResult MulticastFirmwareReceiver::receivePacket()
+		{
+			sockaddr_in sender;
+			socklen_t senderLength = sizeof(sender);
+
+			int received = recvfrom(_socket, _packet, sizeof(_packet), 0, reinterpret_cast<sockaddr*>(&sender), &senderLength);
+
+			if ( received < 0 )
+			{
+				if ( errno == EAGAIN || errno == EWOULDBLOCK )
+				{
+					return ReceiveResult::Timeout;
+				}
+
+				ESP_LOGE(LOG_TAG, "could not receive: %d", errno);
+				return ReceiveResult::Error;
+			}
+
+			PacketHeader header;
+
+			if ( decodeHeader(_packet, received, &header) == false )
+			{
+				return ReceiveResult::Ignored;
+			}
+
+			if ( _sessionKnown == false )
+			{
+				if ( startSession(header) == false )
+				{
+					return ReceiveResult::Ignored;
+				}
+			}
+			else if ( header.sessionID != _sessionID || header.imageSize != _imageSize
+					  || header.chunkSize != _chunkSize || header.groupSize != _groupSize )
+			{
+				return ReceiveResult::Ignored;
+			}
+
+			const uint8_t* payload = _packet + sizeof(PacketHeader);
+			size_t payloadLength = received - sizeof(PacketHeader);
+			bool handled = false;
+
+			if ( header.type == static_cast<uint8_t>(PacketType::Data) )
+			{
+				handled = handleData(header.index, payload, payloadLength);
+			}
+			else if ( header.type == static_cast<uint8_t>(PacketType::Parity) )
+			{
+				handled = handleParity(header.index, payload, payloadLength);
+			}
+
+			if ( handled == false )
+			{
+				return ReceiveResult::Ignored;
+			}
+
+			_seederAddress = sender;
+			_seederKnown = true;
+
+			return ReceiveResult::Handled;
+		}
+
+		bool MulticastFirmwareReceiver::startSession(const PacketHeader &header)
+		{
+			// the chunk bitmap is sized by the announced image, never trust a sender with its size
+			if ( header.imageSize == 0 || header.imageSize > _maxImageSize )
+			{
+				ESP_LOGD(LOG_TAG, "ignoring session %08x with an image of %u bytes", header.sessionID, header.imageSize);
+				return false;
+			}
+
+			_sessionKnown = true;
+			_sessionID = header.sessionID;
+			_imageSize = header.imageSize;
+			_chunkSize = header.chunkSize;
+			_groupSize = header.groupSize;
+
+			_receivedChunks.assign(chunkCount(), false);
+			_receivedCount = 0;
+			_repairCursor = 0;
+			_stats = Stats();
+
+			for ( GroupAccumulator& accumulator : _accumulators )
+			{
+				accumulator.used = false;
+				accumulator.data.assign(_chunkSize, 0);
+			}
+
+			return true;
+		}
+
+		bool MulticastFirmwareReceiver::handleData(uint32_t chunk, const uint8_t *payload, size_t length)
+		{
+			if ( chunk >= chunkCount() || length != chunkLength(chunk) )
+			{
+				return false;
+			}
+
+			GroupAccumulator& accumulator = accumulatorFor(chunk / _groupSize);
+			uint32_t bit = 1u << (chunk % _groupSize);
+
+			if ( (accumulator.seenMask & bit) == 0 )
+			{
+				for ( size_t i = 0; i < length; i++ )
+				{
+					accumulator.data[i] ^= payload[i];
+				}
+				accumulator.seenMask |= bit;
+			}
+
+			if ( _storing )
+			{
+				if ( _receivedChunks[chunk] == false )
+				{
+					storeChunk(chunk, payload);
+					_stats.receivedChunks++;
+				}
+				else
+				{
+					_stats.duplicateChunks++;
+				}
+			}
+
+			tryRecover(accumulator);
+			return true;
+		}
+
+		bool MulticastFirmwareReceiver::handleParity(uint32_t group, const uint8_t *payload, size_t length)
+		{
+			// compare group numbers, group * _groupSize overflows for large indices of a forged packet
+			if ( group >= groupCount() || length != _chunkSize )
+			{
+				return false;
+			}
+
+			GroupAccumulator& accumulator = accumulatorFor(group);
+
+			if ( accumulator.hasParity == false )
+			{
+				for ( size_t i = 0; i < length; i++ )
+				{
+					accumulator.data[i] ^= payload[i];
+				}
+				accumulator.hasParity = true;
+			}
+
+			tryRecover(accumulator);
+			return true;
+		}
+
+		void MulticastFirmwareReceiver::storeChunk(uint32_t chunk, const uint8_t *data)
+		{
+			esp_err_t result = _firmwareWriter->writeFirmwareBytesAt(chunk * _chunkSize, data, chunkLength(chunk));
+
+			if ( result != ESP_OK )
+			{
+				ESP_LOGE(LOG_TAG, "failed writeFirmwareBytesAt with result %s", esp_err_to_name(result) );
+				_writeFailed = true;
+				return;
+			}
+
+			_receivedChunks[chunk] = true;
+			_receivedCount++;
+		}
+
+		MulticastFirmwareReceiver::GroupAccumulator &MulticastFirmwareReceiver::accumulatorFor(uint32_t group)
+		{
+			GroupAccumulator* oldest = &_accumulators[0];
+
+			for ( GroupAccumulator& accumulator : _accumulators )
+			{
+				if ( accumulator.used && accumulator.group == group )
+				{
+					return accumulator;
+				}
+
+				if ( accumulator.used == false || (oldest->used && accumulator.age < oldest->age) )
+				{
+					oldest = &accumulator;
+				}
+			}
+
+			// a group from the next round starts over, the old XOR can not be mixed with a new round
+			oldest->used = true;
+			oldest->group = group;
+			oldest->seenMask = 0;
+			oldest->hasParity = false;
+			oldest->age = ++_accumulatorAge;
+			memset(oldest->data.data(), 0, oldest->data.size());
+
+			return *oldest;
+		}
+
+		void MulticastFirmwareReceiver::tryRecover(GroupAccumulator &accumulator)
+		{
+			uint32_t chunks = chunksInGroup(accumulator.group);
+
+			if ( accumulator.hasParity == false || static_cast<uint32_t>(__builtin_popcount(accumulator.seenMask)) != chunks - 1 )
+			{
+				return;
+			}
+
+			uint32_t missing = 0;
+			while ( accumulator.seenMask & (1u << missing) )
+			{
+				missing++;
+			}
+
+			// the remaining XOR is exactly the missing chunk, zero padded
+			accumulator.seenMask |= 1u << missing;
+
+			uint32_t chunk = accumulator.group * _groupSize + missing;
+
+			if ( _storing && _receivedChunks[chunk] == false )
+			{
+				storeChunk(chunk, accumulator.data.data());
+				_stats.recoveredChunks++;
+			}
+		}
+
+		void MulticastFirmwareReceiver::requestRepairs()
+		{
+			if ( _seederKnown == false )
+			{
+				return;
+			}
+
+			uint8_t request[sizeof(PacketHeader)];
+			uint32_t chunks = chunkCount();
+			uint32_t requests = 0;
+
+			for ( uint32_t checked = 0; checked < chunks && requests < MAX_REPAIR_REQUESTS; checked++ )
+			{
+				uint32_t chunk = _repairCursor;
+				_repairCursor = (_repairCursor + 1) % chunks;
+
+				if ( _receivedChunks[chunk] )
+				{
+					continue;
+				}
+
+				encodeHeader(reinterpret_cast<PacketHeader*>(request), PacketType::RepairRequest, _groupSize, _chunkSize, _sessionID, _imageSize, chunk);
+				sendto(_socket, request, sizeof(request), 0, reinterpret_cast<sockaddr*>(&_seederAddress), sizeof(_seederAddress));
+
+				requests++;
+				_stats.repairRequests++;
+			}
+		}
+
+		uint32_t MulticastFirmwareReceiver::chunkCount() const
+		{
+			return Multicast::chunkCount(_imageSize, _chunkSize);
+		}
+
+		uint32_t MulticastFirmwareReceiver::groupCount() const
+		{
+			uint32_t chunks = chunkCount();
+			return chunks / _groupSize + (chunks % _groupSize != 0 ? 1 : 0);
+		}
+
+		uint16_t MulticastFirmwareReceiver::chunkLength(uint32_t chunk) const
+		{
+			uint32_t remaining = _imageSize - chunk * _chunkSize;
+			return remaining < _chunkSize ? remaining : _chunkSize;
+		}
+
+		uint32_t MulticastFirmwareReceiver::chunksInGroup(uint32_t group) const
+		{
+			uint32_t remaining = chunkCount() - group * _groupSize;
+			return remaining < _groupSize ? remaining : _groupSize;
+		}
+
+	}
+}
@@ -0,0 +1,191 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTICASTFIRMWARERECEIVER_H
+#define MULTICASTFIRMWARERECEIVER_H
+
+#include "MulticastFirmwarePacket.h"
+
+extern "C"
+{
+	#include <netinet/in.h>
+}
+
+#include <vector>
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		class IFirmwareWriter;
+
+        /**
+         * @brief The MulticastFirmwareReceiver class receives a firmware image from a MulticastFirmwareSeeder.
+         *
+         * Chunks arrive in any order and are written with IFirmwareWriter::writeFirmwareBytesAt. A lost chunk is
+         * recovered from the parity packet of its FEC group if it is the only one missing in that group,
+         * everything else is requested unicast from the seeder once the broadcast pauses.
+         *
+         * Typical use with a FirmwareUpdater:
+         *
+         *      receiver.begin("239.255.0.1", 5683, esp_ota_get_next_update_partition(nullptr)->size);
+         *      receiver.waitForSession(60000);
+         *      updater.beginUpdate(receiver.getImageSize());
+         *      receiver.setFirmwareWriter(&updater);
+         *      if ( receiver.receiveFirmware(10000) == 0 ) updater.finishUpdate(); else updater.abortUpdate();
+         */
+		class MulticastFirmwareReceiver
+		{
+			public:
+
+				struct Stats
+				{
+					uint32_t	receivedChunks = { 0 };		///< chunks received, either broadcast or as answer to a repair request
+					uint32_t	recoveredChunks = { 0 };	///< chunks recovered from parity
+					uint32_t	duplicateChunks = { 0 };
+					uint32_t	repairRequests = { 0 };		///< unicast requests sent to the seeder
+				};
+
+									MulticastFirmwareReceiver();
+									~MulticastFirmwareReceiver();
+
+                /**
+                 * @brief           Join the multicast group
+                 *
+                 * @param groupAddress  the multicast group, e.g. "239.255.0.1"
+                 * @param port          the UDP port the seeder sends to
+                 * @param maxImageSize  sessions announcing an empty or larger image are ignored, e.g. the size of the update partition
+                 * @param interfaceAddress  optional address of the interface to join on, e.g. "127.0.0.1" for tests over loopback
+                 *
+                 * @return          \c true on success, otherwise \c false
+                 */
+				bool				begin(const char* groupAddress, uint16_t port, uint32_t maxImageSize, const char* interfaceAddress = nullptr);
+
+                /**
+                 * @brief           Leave the multicast group and release the session
+                 */
+				void				end();
+
+                /**
+                 * @brief           Set the IFirmwareWriter used to write the received chunks, has to support writeFirmwareBytesAt
+                 */
+				void				setFirmwareWriter(IFirmwareWriter* writer);
+
+                /**
+                 * @brief           Wait for the first packet of a seeder and take over its session
+                 * @return          \c true if a session was found, \c false on timeout
+                 */
+				bool				waitForSession(uint32_t timeoutMs);
+
+				uint32_t			getImageSize() const;
+				uint32_t			getSessionID() const;
+
+                /**
+                 * @brief           Receive until the whole image was written
+                 *
+                 * Packets of other sessions or protocols neither count as activity nor trigger repair requests.
+                 *
+                 * @param idleTimeoutMs give up if no packet of the session arrived for this time
+                 *
+                 * @return          \c 0 if the whole image was received and written
+                 * @return          \c -1 on timeout or write error
+                 */
+				int					receiveFirmware(uint32_t idleTimeoutMs);
+
+				bool				isComplete() const;
+
+				const Stats&		getStats() const;
+
+			private:
+
+				enum class ReceiveResult
+				{
+					Error,
+					Timeout,		///< nothing arrived within the receive interval
+					Ignored,		///< a packet arrived, but not one of the session
+					Handled
+				};
+
+				static const size_t	FEC_WINDOW_GROUPS = 4;	///< groups recoverable at the same time, packets arrive roughly in order
+
+                /**
+                 * @brief The GroupAccumulator struct collects the XOR of all packets of a FEC group seen in the current round.
+                 */
+				struct GroupAccumulator
+				{
+					uint32_t				group = { 0 };
+					uint32_t				seenMask = { 0 };
+					uint32_t				age = { 0 };
+					bool					used = { false };
+					bool					hasParity = { false };
+					std::vector<uint8_t>	data;
+				};
+
+                /**
+                 * @brief           Receive and handle one packet, waits up to the receive interval
+                 */
+				ReceiveResult		receivePacket();
+
+                /**
+                 * @brief           Take over the session of a packet
+                 * @return          \c true if the announced image is acceptable, otherwise \c false
+                 */
+				bool				startSession(const Multicast::PacketHeader& header);
+
+                /**
+                 * @return          \c true if the packet fits the session, otherwise \c false
+                 */
+				bool				handleData(uint32_t chunk, const uint8_t* payload, size_t length);
+				bool				handleParity(uint32_t group, const uint8_t* payload, size_t length);
+				void				storeChunk(uint32_t chunk, const uint8_t* data);
+				GroupAccumulator&	accumulatorFor(uint32_t group);
+				void				tryRecover(GroupAccumulator& accumulator);
+				void				requestRepairs();
+
+				uint32_t			chunkCount() const;
+				uint32_t			groupCount() const;
+				uint16_t			chunkLength(uint32_t chunk) const;
+				uint32_t			chunksInGroup(uint32_t group) const;
+
+				int					_socket = { -1 };
+				ip_mreq				_membership = {};
+				sockaddr_in			_seederAddress = {};
+				bool				_seederKnown = { false };
+				IFirmwareWriter*	_firmwareWriter = { nullptr };
+				uint32_t			_maxImageSize = { 0 };
+
+				bool				_sessionKnown = { false };
+				bool				_storing = { false };
+				bool				_writeFailed = { false };
+				uint32_t			_sessionID = { 0 };
+				uint32_t			_imageSize = { 0 };
+				uint16_t			_chunkSize = { 0 };
+				uint8_t				_groupSize = { 0 };
+
+				std::vector<bool>	_receivedChunks;
+				uint32_t			_receivedCount = { 0 };
+				uint32_t			_repairCursor = { 0 };
+				uint32_t			_accumulatorAge = { 0 };
+				GroupAccumulator	_accumulators[FEC_WINDOW_GROUPS];
+				Stats				_stats;
+
+				uint8_t				_packet[Multicast::MAX_PACKET_SIZE];
+		};
+	}
+}
+
+#endif // MULTICASTFIRMWARERECEIVER_H
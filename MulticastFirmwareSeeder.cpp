@@ -0,0 +1,352 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MulticastFirmwareSeeder.h"
+
+extern "C"
+{
+	#include <esp_log.h>
+	#include <esp_timer.h>
+	#include <errno.h>
+	#include <string.h>
+	#include <unistd.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+	#include <arpa/inet.h>
+}
+
+namespace
+{
+	const char*		LOG_TAG						= "IDFix::MulticastFirmwareSeeder";
+	const int64_t	MICROSECONDS_PER_SECOND		= 1000000;
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+		using namespace Multicast;
+
+		MulticastFirmwareSeeder::MulticastFirmwareSeeder()
+		{
+
+		}
+
+		MulticastFirmwareSeeder::~MulticastFirmwareSeeder()
+		{
+			end();
+		}
+
+		bool MulticastFirmwareSeeder::begin(const char *groupAddress, uint16_t port, uint8_t ttl, const char *interfaceAddress)
+		{
+			end();
+
+			_groupAddress.sin_family = AF_INET;
+			_groupAddress.sin_port = htons(port);
+
+			if ( inet_aton(groupAddress, &_groupAddress.sin_addr) == 0 )
+			{
+				ESP_LOGE(LOG_TAG, "invalid multicast group address %s", groupAddress);
+				return false;
+			}
+
+			_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+			if ( _socket < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not create socket: %d", errno);
+				return false;
+			}
+
+			if ( setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not set multicast TTL: %d", errno);
+				end();
+				return false;
+			}
+
+			if ( interfaceAddress != nullptr )
+			{
+				in_addr interface;
+
+				if ( inet_aton(interfaceAddress, &interface) == 0
+					 || setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0 )
+				{
+					ESP_LOGE(LOG_TAG, "could not use interface %s for multicast", interfaceAddress);
+					end();
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		void MulticastFirmwareSeeder::end()
+		{
+			if ( _socket >= 0 )
+			{
+				close(_socket);
+				_socket = -1;
+			}
+		}
+
+		void MulticastFirmwareSeeder::setImage(const void *image, uint32_t size, uint32_t sessionID)
+		{
+			_image = static_cast<const uint8_t*>(image);
+			_imageSize = size;
+			_sessionID = sessionID;
+		}
+
+		bool MulticastFirmwareSeeder::setChunking(uint16_t chunkSize, uint8_t groupSize)
+		{
+			if ( chunkSize < MIN_CHUNK_SIZE || chunkSize > MAX_CHUNK_SIZE || groupSize == 0 || groupSize > MAX_GROUP_SIZE )
+			{
+				return false;
+			}
+
+			_chunkSize = chunkSize;
+			_groupSize = groupSize;
+			return true;
+		}
+
+		void MulticastFirmwareSeeder::setPacketInterval(uint32_t intervalUs)
+		{
+			_packetIntervalUs = intervalUs;
+		}
+
+		void MulticastFirmwareSeeder::setRepairBudget(uint32_t bytesPerSecondPerHost, uint32_t bytesPerSecond)
+		{
+			_hostRepairRate = bytesPerSecondPerHost;
+			_totalRepairRate = bytesPerSecond;
+
+			for ( RepairBucket& bucket : _hostBuckets )
+			{
+				bucket.used = false;
+			}
+
+			_totalBucket.used = false;
+		}
+
+		const MulticastFirmwareSeeder::Stats &MulticastFirmwareSeeder::getStats() const
+		{
+			return _stats;
+		}
+
+		bool MulticastFirmwareSeeder::sendRound()
+		{
+			if ( _socket < 0 || _image == nullptr || _imageSize == 0 )
+			{
+				ESP_LOGE(LOG_TAG, "seeder not started or no image set!");
+				return false;
+			}
+
+			uint32_t chunks = chunkCount();
+
+			for ( uint32_t chunk = 0; chunk < chunks; chunk++ )
+			{
+				if ( sendData(chunk, _groupAddress) == false )
+				{
+					return false;
+				}
+
+				bool lastOfGroup = ((chunk + 1) % _groupSize == 0) || (chunk + 1 == chunks);
+
+				if ( lastOfGroup && sendParity(chunk / _groupSize) == false )
+				{
+					return false;
+				}
+
+				handleRepairRequests(0);
+
+				if ( _packetIntervalUs > 0 )
+				{
+					usleep(_packetIntervalUs);
+				}
+			}
+
+			return true;
+		}
+
+		void MulticastFirmwareSeeder::serveRepairs(uint32_t durationMs)
+		{
+			int64_t start = esp_timer_get_time();
+			uint32_t elapsedMs = 0;
+
+			while ( elapsedMs < durationMs )
+			{
+				handleRepairRequests(durationMs - elapsedMs);
+				elapsedMs = (esp_timer_get_time() - start) / 1000;
+			}
+		}
+
+		uint32_t MulticastFirmwareSeeder::chunkCount() const
+		{
+			return Multicast::chunkCount(_imageSize, _chunkSize);
+		}
+
+		uint16_t MulticastFirmwareSeeder::chunkLength(uint32_t chunk) const
+		{
+			uint32_t remaining = _imageSize - chunk * _chunkSize;
+			return remaining < _chunkSize ? remaining : _chunkSize;
+		}
+
+		bool MulticastFirmwareSeeder::sendData(uint32_t chunk, const sockaddr_in &destination)
+		{
+			uint16_t length = chunkLength(chunk);
+
+			encodeHeader(reinterpret_cast<PacketHeader*>(_packet), PacketType::Data, _groupSize, _chunkSize, _sessionID, _imageSize, chunk);
+			memcpy(_packet + sizeof(PacketHeader), _image + chunk * _chunkSize, length);
+
+			if ( sendto(_socket, _packet, sizeof(PacketHeader) + length, 0, reinterpret_cast<const sockaddr*>(&destination), sizeof(destination)) < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not send chunk %u: %d", chunk, errno);
+				return false;
+			}
+
+			return true;
+		}
+
+		bool MulticastFirmwareSeeder::sendParity(uint32_t group)
+		{
+			uint8_t* parity = _packet + sizeof(PacketHeader);
+			memset(parity, 0, _chunkSize);
+
+			uint32_t firstChunk = group * _groupSize;
+			uint32_t endChunk = firstChunk + _groupSize < chunkCount() ? firstChunk + _groupSize : chunkCount();
+
+			for ( uint32_t chunk = firstChunk; chunk < endChunk; chunk++ )
+			{
+				const uint8_t* data = _image + chunk * _chunkSize;
+				uint16_t length = chunkLength(chunk);
+
+				for ( uint16_t i = 0; i < length; i++ )
+				{
+					parity[i] ^= data[i];
+				}
+			}
+
+			encodeHeader(reinterpret_cast<PacketHeader*>(_packet), PacketType::Parity, _groupSize, _chunkSize, _sessionID, _imageSize, group);
+
+			if ( sendto(_socket, _packet, sizeof(PacketHeader) + _chunkSize, 0, reinterpret_cast<const sockaddr*>(&_groupAddress), sizeof(_groupAddress)) < 0 )
+			{
+				ESP_LOGE(LOG_TAG, "could not send parity of group %u: %d", group, errno);
+				return false;
+			}
+
+			return true;
+		}
+
+		void MulticastFirmwareSeeder::handleRepairRequests(uint32_t waitMs)
+		{
+			struct timeval timeout;
+			timeout.tv_sec = waitMs / 1000;
+			timeout.tv_usec = (waitMs % 1000) * 1000;
+			setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+			int flags = waitMs > 0 ? 0 : MSG_DONTWAIT;
+			uint8_t request[sizeof(PacketHeader)];
+			sockaddr_in requester;
+			socklen_t requesterLength = sizeof(requester);
+
+			int received;
+
+			while ( (received = recvfrom(_socket, request, sizeof(request), flags, reinterpret_cast<sockaddr*>(&requester), &requesterLength)) > 0 )
+			{
+				PacketHeader header;
+
+				if ( decodeHeader(request, received, &header) && header.type == static_cast<uint8_t>(PacketType::RepairRequest)
+					 && header.sessionID == _sessionID && header.index < chunkCount()
+					 && takeRepairBudget(requester, sizeof(PacketHeader) + chunkLength(header.index)) )
+				{
+					sendData(header.index, requester);
+					_stats.answeredRepairs++;
+				}
+				else
+				{
+					_stats.droppedRepairs++;
+				}
+
+				// only the first request is waited for, everything queued behind it is handled right away
+				flags = MSG_DONTWAIT;
+				requesterLength = sizeof(requester);
+			}
+		}
+
+		bool MulticastFirmwareSeeder::takeRepairBudget(const sockaddr_in &requester, size_t bytes)
+		{
+			int64_t now = esp_timer_get_time();
+			RepairBucket& host = repairBucketFor(requester.sin_addr.s_addr);
+			RepairBucket* buckets[] = { &host, &_totalBucket };
+			uint32_t rates[] = { _hostRepairRate, _totalRepairRate };
+
+			for ( size_t i = 0; i < 2; i++ )
+			{
+				RepairBucket& bucket = *buckets[i];
+
+				// a new bucket starts full, one second worth of data
+				if ( bucket.used == false )
+				{
+					bucket.used = true;
+					bucket.tokens = rates[i];
+					bucket.refillTimestamp = now;
+					continue;
+				}
+
+				// only move the timestamp once whole bytes were added, frequent requests would never refill otherwise
+				int64_t refill = (now - bucket.refillTimestamp) * rates[i] / MICROSECONDS_PER_SECOND;
+
+				if ( refill > 0 || bucket.tokens >= rates[i] )
+				{
+					bucket.tokens = bucket.tokens + refill < rates[i] ? bucket.tokens + refill : rates[i];
+					bucket.refillTimestamp = now;
+				}
+			}
+
+			if ( host.tokens < static_cast<int64_t>(bytes) || _totalBucket.tokens < static_cast<int64_t>(bytes) )
+			{
+				return false;
+			}
+
+			host.tokens -= bytes;
+			_totalBucket.tokens -= bytes;
+			return true;
+		}
+
+		MulticastFirmwareSeeder::RepairBucket &MulticastFirmwareSeeder::repairBucketFor(in_addr_t address)
+		{
+			RepairBucket* leastRecent = &_hostBuckets[0];
+
+			for ( RepairBucket& bucket : _hostBuckets )
+			{
+				if ( bucket.used && bucket.address == address )
+				{
+					return bucket;
+				}
+
+				if ( bucket.used == false || (leastRecent->used && bucket.refillTimestamp < leastRecent->refillTimestamp) )
+				{
+					leastRecent = &bucket;
+				}
+			}
+
+			leastRecent->used = false;
+			leastRecent->address = address;
+			return *leastRecent;
+		}
+
+	}
+}
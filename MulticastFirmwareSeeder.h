@@ -0,0 +1,175 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTICASTFIRMWARESEEDER_H
+#define MULTICASTFIRMWARESEEDER_H
+
+#include "MulticastFirmwarePacket.h"
+
+extern "C"
+{
+	#include <netinet/in.h>
+}
+
+namespace IDFix
+{
+	namespace FOTA
+	{
+        /**
+         * @brief The MulticastFirmwareSeeder class broadcasts a firmware image to a UDP multicast group.
+         *
+         * The image is sent in rounds (carousel), each FEC group of chunks is followed by a parity packet
+         * which allows the receivers to recover one lost chunk per group. Chunks that are still missing can be
+         * requested unicast by the receivers, the seeder answers these requests between its packets.
+         *
+         * A repair request is much smaller than its answer and its sender address is not authenticated, so the
+         * answers are limited by a budget per requesting host and a total budget. Otherwise a spoofed request
+         * stream would make the seeder flood a third party with chunks.
+         *
+         * The image has to be fully accessible in memory, e.g. a file on the host or a partition mapped with
+         * esp_partition_mmap on the device.
+         */
+		class MulticastFirmwareSeeder
+		{
+			public:
+
+				struct Stats
+				{
+					uint32_t	answeredRepairs = { 0 };
+					uint32_t	droppedRepairs = { 0 };		///< requests over budget, or not matching the session
+				};
+
+				static const uint32_t	DEFAULT_REPAIR_BYTES_PER_SECOND_PER_HOST = 64 * 1024;
+				static const uint32_t	DEFAULT_REPAIR_BYTES_PER_SECOND = 256 * 1024;
+
+									MulticastFirmwareSeeder();
+									~MulticastFirmwareSeeder();
+
+                /**
+                 * @brief           Open the socket used to send to the multicast group
+                 *
+                 * @param groupAddress  the multicast group, e.g. "239.255.0.1"
+                 * @param port          the UDP port the receivers listen on
+                 * @param ttl           multicast TTL, 1 keeps the packets in the local network
+                 * @param interfaceAddress  optional address of the interface to send on, e.g. "127.0.0.1" for tests over loopback
+                 *
+                 * @return          \c true on success, otherwise \c false
+                 */
+				bool				begin(const char* groupAddress, uint16_t port, uint8_t ttl = 1, const char* interfaceAddress = nullptr);
+
+                /**
+                 * @brief           Close the socket
+                 */
+				void				end();
+
+                /**
+                 * @brief           Set the image to distribute
+                 *
+                 * @param image     the packaged firmware image, has to stay valid while seeding
+                 * @param size      size of the image in bytes
+                 * @param sessionID identifies the image, receivers ignore packets of other sessions
+                 */
+				void				setImage(const void* image, uint32_t size, uint32_t sessionID);
+
+                /**
+                 * @brief           Set chunk and FEC group size, only valid before the first round
+                 * @return          \c false if the chunk size is outside of MIN_CHUNK_SIZE and MAX_CHUNK_SIZE or the group size too large
+                 */
+				bool				setChunking(uint16_t chunkSize, uint8_t groupSize);
+
+                /**
+                 * @brief           Set the pause between two packets to limit the bandwidth of the broadcast
+                 */
+				void				setPacketInterval(uint32_t intervalUs);
+
+                /**
+                 * @brief           Limit the bandwidth spent on answering repair requests
+                 *
+                 * Each budget allows a burst of one second worth of data.
+                 *
+                 * @param bytesPerSecondPerHost answers to a single requesting IP address
+                 * @param bytesPerSecond        answers to all requesters together
+                 */
+				void				setRepairBudget(uint32_t bytesPerSecondPerHost, uint32_t bytesPerSecond);
+
+				const Stats&		getStats() const;
+
+                /**
+                 * @brief           Send all chunks and parity packets once, answering repair requests in between
+                 * @return          \c true on success, \c false if sending failed
+                 */
+				bool				sendRound();
+
+                /**
+                 * @brief           Only answer repair requests for the given time
+                 */
+				void				serveRepairs(uint32_t durationMs);
+
+			private:
+
+				static const size_t	REPAIR_HOSTS = 16;		///< hosts with a budget of their own, the least recently served one is replaced
+
+				struct RepairBucket
+				{
+					in_addr_t		address = { 0 };
+					int64_t			tokens = { 0 };
+					int64_t			refillTimestamp = { 0 };
+					bool			used = { false };
+				};
+
+				uint32_t			chunkCount() const;
+				uint16_t			chunkLength(uint32_t chunk) const;
+
+				bool				sendData(uint32_t chunk, const sockaddr_in& destination);
+				bool				sendParity(uint32_t group);
+
+                /**
+                 * @brief           Answer all pending repair requests
+                 * @param waitMs    time to wait for the first request, \c 0 to only handle queued requests
+                 */
+				void				handleRepairRequests(uint32_t waitMs);
+
+                /**
+                 * @brief           Take the size of an answer from the budget of the requester and the total budget
+                 * @return          \c true if both budgets allow the answer, otherwise \c false and nothing is taken
+                 */
+				bool				takeRepairBudget(const sockaddr_in& requester, size_t bytes);
+
+				RepairBucket&		repairBucketFor(in_addr_t address);
+
+				int					_socket = { -1 };
+				sockaddr_in			_groupAddress = {};
+
+				const uint8_t*		_image = { nullptr };
+				uint32_t			_imageSize = { 0 };
+				uint32_t			_sessionID = { 0 };
+				uint16_t			_chunkSize = { Multicast::DEFAULT_CHUNK_SIZE };
+				uint8_t				_groupSize = { Multicast::DEFAULT_GROUP_SIZE };
+				uint32_t			_packetIntervalUs = { 0 };
+
+				uint32_t			_hostRepairRate = { DEFAULT_REPAIR_BYTES_PER_SECOND_PER_HOST };
+				uint32_t			_totalRepairRate = { DEFAULT_REPAIR_BYTES_PER_SECOND };
+				RepairBucket		_hostBuckets[REPAIR_HOSTS];
+				RepairBucket		_totalBucket;
+				Stats				_stats;
+
+				uint8_t				_packet[Multicast::MAX_PACKET_SIZE];
+		};
+	}
+}
+
+#endif // MULTICASTFIRMWARESEEDER_H
@@ -0,0 +1,211 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeFlash.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/HarnessUpdater.h"
+#include "fakes/TestCrypto.h"
+
+#include "FirmwareImageCache.h"
+
+extern "C"
+{
+	#include "esp_rom_crc.h"
+}
+
+#include <vector>
+
+/*
+ * Tests that the image cache keeps its entries through failed updates and that cached images are not
+ * trusted more than downloaded ones.
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::FirmwareImageCache;
+
+namespace
+{
+	const char		MAGIC_BYTES[]			= "IDFIXFW1";
+	const size_t	MAGIC_LENGTH			= sizeof(MAGIC_BYTES) - 1;
+	const uint8_t	SIGNING_KEY				= 0x5A;
+	const uint8_t	ROTATED_KEY				= 0x3C;
+
+	/* payload | magic bytes | signature | signature length */
+	std::vector<uint8_t> buildImage(size_t payloadSize, uint8_t fill, uint8_t key)
+	{
+		std::vector<uint8_t> image(payloadSize, fill);
+		image[0] = 0xE9;
+		image.insert(image.end(), MAGIC_BYTES, MAGIC_BYTES + MAGIC_LENGTH);
+
+		std::vector<uint8_t> signature = TestVerifier::sign(TestHash::digest(image.data(), image.size()), key);
+		uint32_t signatureLength = signature.size();
+
+		image.insert(image.end(), signature.begin(), signature.end());
+		image.insert(image.end(), reinterpret_cast<uint8_t*>(&signatureLength), reinterpret_cast<uint8_t*>(&signatureLength) + sizeof(signatureLength));
+
+		return image;
+	}
+
+	struct Device
+	{
+		Device()
+		{
+			FakeFlash::reset();
+			FakeNVS::clear();
+			CHECK(cache.begin("fota_cache"), "no cache partition");
+		}
+
+		bool install(const std::vector<uint8_t>& image, size_t failAfter = SIZE_MAX)
+		{
+			HarnessUpdater updater;
+			TestHash hash;
+			TestVerifier verifier(key);
+			prepare(updater, verifier, hash);
+
+			if ( updater.beginUpdate(image.size()) == false )
+			{
+				return false;
+			}
+
+			size_t size = image.size() < failAfter ? image.size() : failAfter;
+
+			if ( updater.writeFirmwareBytes(image.data(), size) != ESP_OK || size < image.size() )
+			{
+				updater.abortUpdate();
+				return false;
+			}
+
+			return updater.finishUpdate();
+		}
+
+		bool installFromCache(FirmwareImageCache::Entry entry)
+		{
+			HarnessUpdater updater;
+			TestHash hash;
+			TestVerifier verifier(key);
+			prepare(updater, verifier, hash);
+
+			return updater.installFromCache(entry);
+		}
+
+		void prepare(HarnessUpdater& updater, TestVerifier& verifier, TestHash& hash)
+		{
+			updater.setMagicBytes(MAGIC_BYTES, MAGIC_LENGTH);
+			updater.installSignatureVerifier(&verifier, &hash);
+			updater.setImageCache(&cache);
+		}
+
+		uint32_t cachedCRC(FirmwareImageCache::Entry entry)
+		{
+			FirmwareImageCache::EntryInfo info;
+			return cache.getEntryInfo(entry, &info) ? info.imageCRC : 0;
+		}
+
+		FirmwareImageCache		cache;
+		uint8_t					key = { SIGNING_KEY };
+	};
+
+	uint32_t crcOf(const std::vector<uint8_t>& image)
+	{
+		return esp_rom_crc32_le(0, image.data(), image.size());
+	}
+
+	bool bootsImage(const std::vector<uint8_t>& image)
+	{
+		return FakeFlash::read(FakeFlash::bootPartition(), 0, image.size()) == image;
+	}
+
+	/* neither a failed nor an interrupted download costs the image a rollback needs */
+	void testFailedUpdateKeepsRollback()
+	{
+		Device device;
+		std::vector<uint8_t> first = buildImage(200 * 1024, 0x11, SIGNING_KEY);
+		std::vector<uint8_t> second = buildImage(150 * 1024, 0x22, SIGNING_KEY);
+		std::vector<uint8_t> third = buildImage(300 * 1024, 0x33, SIGNING_KEY);
+
+		CHECK(device.install(first), "first update failed");
+		FakeFlash::reboot();
+		CHECK(device.install(second), "second update failed");
+		FakeFlash::reboot();
+
+		CHECK(device.cachedCRC(FirmwareImageCache::Entry::Latest) == crcOf(second), "latest entry is not the second image");
+		CHECK(device.cachedCRC(FirmwareImageCache::Entry::Previous) == crcOf(first), "previous entry is not the first image");
+
+		CHECK(device.install(third, 100 * 1024) == false, "update with a failed download succeeded");
+
+		FakeFlash::powerCutAtOperation(40);
+		bool powerCut = false;
+
+		try
+		{
+			device.install(third);
+		}
+		catch ( const PowerCut& )
+		{
+			powerCut = true;
+		}
+
+		CHECK(powerCut, "no power cut during the update");
+		FakeFlash::reboot();
+		HarnessUpdater::simulateReboot();
+
+		FirmwareImageCache rebooted;
+		CHECK(rebooted.begin("fota_cache"), "no cache partition");
+		device.cache = rebooted;
+
+		CHECK(device.cachedCRC(FirmwareImageCache::Entry::Latest) == crcOf(second), "failed updates lost the latest entry");
+		CHECK(device.cachedCRC(FirmwareImageCache::Entry::Previous) == crcOf(first), "failed updates lost the previous entry");
+
+		CHECK(device.installFromCache(FirmwareImageCache::Entry::Previous), "rollback failed");
+		FakeFlash::reboot();
+		CHECK(bootsImage(first), "rollback does not boot the first image");
+	}
+
+	/* the verified flag of an entry is no reason to skip the signature check */
+	void testCachedImagesAreVerified()
+	{
+		Device device;
+		std::vector<uint8_t> good = buildImage(64 * 1024, 0x44, SIGNING_KEY);
+		std::vector<uint8_t> forged = buildImage(64 * 1024, 0x55, 0xA5);
+
+		CHECK(device.install(good), "update failed");
+		FakeFlash::reboot();
+
+		// what anyone able to write the cache partition can do
+		CHECK(device.cache.beginWrite(forged.size()), "cache write not started");
+		CHECK(device.cache.write(forged.data(), forged.size()) == ESP_OK, "cache write failed");
+		CHECK(device.cache.commit(true), "cache commit failed");
+
+		CHECK(device.installFromCache(FirmwareImageCache::Entry::Latest) == false, "forged cache entry installed");
+		CHECK(bootsImage(good), "boot image changed");
+
+		// an image cached under the old key does not come back after a key rotation
+		device.key = ROTATED_KEY;
+		CHECK(device.installFromCache(FirmwareImageCache::Entry::Previous) == false, "image signed with the old key installed");
+		CHECK(bootsImage(good), "boot image changed");
+	}
+}
+
+int main()
+{
+	testFailedUpdateKeepsRollback();
+	testCachedImagesAreVerified();
+
+	printf("image cache: all ok\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeFlash.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/HarnessUpdater.h"
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * Tests that updates interrupted early can be resumed and that updates without resume leave NVS alone.
+ */
+
+using namespace HostTest;
+
+namespace
+{
+	const size_t	IMAGE_SIZE				= 200 * 1024;
+	const size_t	WRITE_SIZE				= 4096;
+
+	/* unsigned image, it ends with a signature length of 0 */
+	std::vector<uint8_t> testImage()
+	{
+		std::vector<uint8_t> image(IMAGE_SIZE);
+
+		for ( size_t i = 0; i < image.size(); i++ )
+		{
+			image[i] = static_cast<uint8_t>(i * 13);
+		}
+
+		image[0] = 0xE9;
+		std::fill(image.end() - sizeof(uint32_t), image.end(), 0);
+
+		return image;
+	}
+
+	void writeImage(HarnessUpdater& updater, const std::vector<uint8_t>& image, size_t from, size_t to)
+	{
+		for ( size_t offset = from; offset < to; offset += WRITE_SIZE )
+		{
+			size_t size = std::min(WRITE_SIZE, to - offset);
+			CHECK(updater.writeFirmwareBytes(&image[offset], size) == ESP_OK, "write at %u failed", static_cast<unsigned>(offset));
+		}
+	}
+
+	/* the power is lost long before the first 64 KiB are written, the update continues where it was */
+	void testResumeEarlyPowerLoss()
+	{
+		std::vector<uint8_t> image = testImage();
+
+		for ( size_t lostAt : { static_cast<size_t>(2048), static_cast<size_t>(6 * 1024), static_cast<size_t>(40 * 1024) } )
+		{
+			FakeFlash::reset();
+			FakeNVS::clear();
+
+			{
+				HarnessUpdater updater;
+				updater.setResumable(true);
+				CHECK(updater.beginUpdate(image.size()), "beginUpdate failed");
+				writeImage(updater, image, 0, lostAt);
+			}
+
+			FakeFlash::reboot();
+			HarnessUpdater::simulateReboot();
+
+			HarnessUpdater updater;
+			updater.setResumable(true);
+			size_t offset = SIZE_MAX;
+
+			CHECK(updater.resumeUpdate(image.size(), &offset), "update interrupted after %u bytes not resumed", static_cast<unsigned>(lostAt));
+			CHECK(offset <= lostAt && offset % SPI_FLASH_SEC_SIZE == 0, "resumed at %u after %u bytes", static_cast<unsigned>(offset), static_cast<unsigned>(lostAt));
+			CHECK(lostAt < 2 * SPI_FLASH_SEC_SIZE || offset > 0, "nothing kept of %u bytes", static_cast<unsigned>(lostAt));
+
+			writeImage(updater, image, offset, image.size());
+			CHECK(updater.finishUpdate(), "resumed update not installed");
+			CHECK(FakeFlash::read(FakeFlash::bootPartition(), 0, image.size()) == image, "boot partition does not hold the image");
+		}
+	}
+
+	/* without setResumable(true) the updater neither writes nor creates anything in NVS */
+	void testNoResumeNoNVS()
+	{
+		std::vector<uint8_t> image = testImage();
+
+		FakeFlash::reset();
+		FakeNVS::clear();
+
+		HarnessUpdater updater;
+		CHECK(updater.beginUpdate(image.size()), "beginUpdate failed");
+		writeImage(updater, image, 0, image.size());
+		CHECK(updater.finishUpdate(), "update not installed");
+
+		CHECK(updater.beginUpdate(image.size()), "beginUpdate failed");
+		writeImage(updater, image, 0, image.size() / 2);
+		CHECK(updater.abortUpdate(), "abortUpdate failed");
+
+		CHECK(FakeNVS::readWriteOpenCount() == 0, "NVS opened %u times for writing", FakeNVS::readWriteOpenCount());
+		CHECK(FakeNVS::writeCount() == 0, "%u NVS writes", FakeNVS::writeCount());
+	}
+}
+
+int main()
+{
+	testResumeEarlyPowerLoss();
+	testNoResumeNoNVS();
+
+	printf("resume: all ok\n");
+	return 0;
+}
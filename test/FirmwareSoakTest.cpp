@@ -0,0 +1,550 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeClock.h"
+#include "fakes/FakeFlash.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/FakeFirmwareSource.h"
+#include "fakes/HarnessUpdater.h"
+#include "fakes/TestCrypto.h"
+
+#include "FirmwareImageCache.h"
+#include "FirmwareTransfer.h"
+
+extern "C"
+{
+	#include "esp_rom_crc.h"
+}
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Runs thousands of randomized update transactions against fault injecting fakes of the flash and the
+ * firmware source. Whatever happens, the boot partition must either stay on the old image or switch to
+ * the complete new one, and the image cache has to keep its entries unless the update is installed.
+ * Power cuts are followed by a simulated reboot and a recovery, the time the recovery takes is reported
+ * for resumed updates, resumable updates that found nothing to resume and restarted updates.
+ *
+ * usage: FirmwareSoakTest [iterations] [seed]
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::FirmwareImageCache;
+using IDFix::FOTA::FirmwareTransfer;
+
+namespace
+{
+	const char		MAGIC_BYTES[]			= "IDFIXFW1";
+	const size_t	MAGIC_LENGTH			= sizeof(MAGIC_BYTES) - 1;
+	const uint8_t	SIGNING_KEY				= 0x5A;
+	const uint8_t	WRONG_KEY				= 0xA5;
+	const size_t	MIN_PAYLOAD_SIZE		= 8 * 1024;
+	const size_t	MAX_PAYLOAD_SIZE		= 320 * 1024;
+	const int		MAX_ATTEMPTS			= 8;
+	const int		MAX_POWER_CUTS			= 4;
+	const int64_t	STALL_TIMEOUT_US		= 30 * 1000000LL;
+
+	enum class Scenario
+	{
+		Clean,
+		ShortReads,
+		ShortStall,
+		LongStall,
+		Truncated,
+		SourceError,
+		Corrupted,
+		BadSignature,
+		WriteFailure,
+		PowerCut,
+		UnknownLength,
+		Count
+	};
+
+	const char* SCENARIO_NAMES[] =
+	{
+		"clean", "short reads", "short stall", "long stall", "truncated", "source error",
+		"corrupted", "bad signature", "write failure", "power cut", "unknown length"
+	};
+
+	bool expectInstalled(Scenario scenario)
+	{
+		switch ( scenario )
+		{
+			case Scenario::Clean:
+			case Scenario::ShortReads:
+			case Scenario::ShortStall:
+			case Scenario::PowerCut:
+			case Scenario::UnknownLength:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	class Random
+	{
+		public:
+
+			explicit	Random(uint32_t seed) : _state(seed != 0 ? seed : 1) {}
+
+			uint32_t next()
+			{
+				_state ^= _state << 13;
+				_state ^= _state >> 17;
+				_state ^= _state << 5;
+				return _state;
+			}
+
+			uint32_t	below(uint32_t limit) { return next() % limit; }
+			uint32_t	between(uint32_t low, uint32_t high) { return low + below(high - low + 1); }
+			bool		chance(uint32_t percent) { return below(100) < percent; }
+
+		private:
+
+			uint32_t	_state;
+	};
+
+	/* payload | magic bytes | signature | signature length */
+	std::vector<uint8_t> buildImage(Random& random, size_t payloadSize, uint8_t key)
+	{
+		std::vector<uint8_t> image(payloadSize);
+
+		for ( uint8_t& byte : image )
+		{
+			byte = static_cast<uint8_t>(random.next());
+		}
+
+		image[0] = 0xE9;
+		image.insert(image.end(), MAGIC_BYTES, MAGIC_BYTES + MAGIC_LENGTH);
+
+		std::vector<uint8_t> signature = TestVerifier::sign(TestHash::digest(image.data(), image.size()), key);
+		uint32_t signatureLength = signature.size();
+
+		image.insert(image.end(), signature.begin(), signature.end());
+		image.insert(image.end(), reinterpret_cast<uint8_t*>(&signatureLength), reinterpret_cast<uint8_t*>(&signatureLength) + sizeof(signatureLength));
+
+		return image;
+	}
+
+	bool partitionHolds(const esp_partition_t* partition, const std::vector<uint8_t>& image)
+	{
+		return FakeFlash::read(partition, 0, image.size()) == image;
+	}
+
+	struct Options
+	{
+		FirmwareTransfer::ThrottleConfig	throttle;
+		FirmwareTransfer::BufferConfig		buffer;
+		bool								resumable = { false };
+		bool								unknownLength = { false };
+		bool								sequentialErase = { false };
+	};
+
+	enum class Result
+	{
+		Installed,
+		Failed,
+		NotResumed
+	};
+
+	struct ScenarioStats
+	{
+		uint32_t	runs = { 0 };
+		uint32_t	installed = { 0 };
+		int64_t		totalUs = { 0 };
+	};
+
+	/* CRCs of the cached images, 0 for a missing entry */
+	struct CacheState
+	{
+		uint32_t	latest = { 0 };
+		uint32_t	previous = { 0 };
+	};
+
+	struct RecoveryStats
+	{
+		uint32_t	count = { 0 };
+		int64_t		totalUs = { 0 };
+		int64_t		maxUs = { 0 };
+		uint64_t	transferredBytes = { 0 };
+		uint64_t	imageBytes = { 0 };
+
+		void add(int64_t us, size_t transferred, size_t imageSize)
+		{
+			count++;
+			totalUs += us;
+			maxUs = us > maxUs ? us : maxUs;
+			transferredBytes += transferred;
+			imageBytes += imageSize;
+		}
+
+		void print(const char* name) const
+		{
+			if ( count == 0 )
+			{
+				printf("  %-12s none\n", name);
+				return;
+			}
+
+			printf("  %-12s %5u recoveries, avg %7.2f s, max %7.2f s, %5.1f %% of the image transferred again\n", name, count,
+				   totalUs / 1e6 / count, maxUs / 1e6, 100.0 * transferredBytes / imageBytes);
+		}
+	};
+
+	class Soak
+	{
+		public:
+
+			explicit Soak(uint32_t seed) :
+				_random(seed)
+			{
+				FakeFlash::reset();
+				FakeNVS::clear();
+
+				FakeFlash::Timing timing;
+				timing.sectorEraseUs = 45000;
+				timing.blockEraseUs = 150000;
+				timing.writeUsPerKiB = 2400;
+				FakeFlash::setTiming(timing);
+
+				// the factory image
+				_bootImage = buildImage(_random, MIN_PAYLOAD_SIZE, SIGNING_KEY);
+				esp_partition_write(FakeFlash::otaPartition(0), 0, _bootImage.data(), _bootImage.size());
+
+				CHECK(_cache.begin("fota_cache"), "no image cache partition");
+			}
+
+			void run(uint32_t iterations)
+			{
+				for ( uint32_t i = 0; i < iterations; i++ )
+				{
+					iteration(i);
+				}
+
+				CHECK(FakeFlash::stats().bootSwitches == _installs, "%u boot switches for %u installs", FakeFlash::stats().bootSwitches, _installs);
+				report();
+			}
+
+		private:
+
+			Options randomOptions()
+			{
+				static const size_t READ_SIZES[] = { 256, 512, 1024, 4096 };
+
+				Options options;
+
+				if ( _random.chance(30) )
+				{
+					options.throttle.maxBytesPerSecond = _random.between(16 * 1024, 256 * 1024);
+					options.throttle.burstBytes = _random.chance(50) ? 0 : _random.between(1024, 16 * 1024);
+				}
+
+				if ( _random.chance(30) )
+				{
+					options.throttle.writeDutyCyclePercent = _random.between(10, 100);
+				}
+
+				options.buffer.minReadSize = READ_SIZES[_random.below(4)];
+				options.buffer.maxReadSize = options.buffer.minReadSize << _random.below(5);
+				options.resumable = _random.chance(50);
+				options.unknownLength = _random.chance(10);
+				options.sequentialErase = _random.chance(30);
+
+				return options;
+			}
+
+			Result runUpdate(FakeFirmwareSource& source, size_t imageSize, const Options& options, bool resume)
+			{
+				TestHash hash;
+				TestVerifier verifier(SIGNING_KEY);
+				HarnessUpdater updater;
+
+				updater.setMagicBytes(MAGIC_BYTES, MAGIC_LENGTH);
+				updater.installSignatureVerifier(&verifier, &hash);
+				updater.setResumable(options.resumable);
+				updater.setImageCache(&_cache);
+
+				size_t updateSize = options.sequentialErase ? OTA_WITH_SEQUENTIAL_WRITES : options.unknownLength ? OTA_SIZE_UNKNOWN : imageSize;
+				size_t offset = 0;
+
+				if ( resume )
+				{
+					if ( updater.resumeUpdate(updateSize, &offset) == false )
+					{
+						return Result::NotResumed;
+					}
+				}
+				else if ( updater.beginUpdate(updateSize) == false )
+				{
+					return Result::Failed;
+				}
+
+				FirmwareTransfer transfer;
+				transfer.setSourceOffset(offset);
+				transfer.setThrottle(options.throttle);
+				transfer.setBufferConfig(options.buffer);
+				transfer.setFirmwareSource(&source);
+				transfer.setFirmwareWriter(&updater);
+
+				if ( transfer.transferFirmware() != 0 )
+				{
+					updater.abortUpdate();
+					return Result::Failed;
+				}
+
+				return updater.finishUpdate() ? Result::Installed : Result::Failed;
+			}
+
+			FakeFirmwareSource::Faults faultsFor(Scenario scenario, size_t imageSize)
+			{
+				FakeFirmwareSource::Faults faults;
+				size_t offset = _random.below(imageSize);
+
+				switch ( scenario )
+				{
+					case Scenario::ShortReads:		faults.shortReads = true; break;
+					case Scenario::ShortStall:		faults.stallAt = offset; faults.stallUs = _random.between(1, 20) * 1000000LL; break;
+					case Scenario::LongStall:		faults.stallAt = offset; faults.stallUs = STALL_TIMEOUT_US + _random.between(1, 30) * 1000000LL; break;
+					case Scenario::Truncated:		faults.truncateAt = offset; break;
+					case Scenario::SourceError:		faults.errorAt = offset; break;
+					case Scenario::Corrupted:		faults.corruptAt = offset; break;
+					default:						break;
+				}
+
+				faults.shortReads = faults.shortReads || _random.chance(20);
+				return faults;
+			}
+
+			CacheState cacheState() const
+			{
+				CacheState state;
+				FirmwareImageCache::EntryInfo info;
+
+				if ( _cache.getEntryInfo(FirmwareImageCache::Entry::Latest, &info) )
+				{
+					state.latest = info.imageCRC;
+				}
+
+				if ( _cache.getEntryInfo(FirmwareImageCache::Entry::Previous, &info) )
+				{
+					state.previous = info.imageCRC;
+				}
+
+				return state;
+			}
+
+			bool cacheEntryIntact(FirmwareImageCache::Entry entry) const
+			{
+				FirmwareImageCache::EntryInfo info;
+
+				if ( _cache.getEntryInfo(entry, &info) == false )
+				{
+					return true;
+				}
+
+				uint8_t buffer[4096];
+				uint32_t crc = 0;
+
+				for ( size_t offset = 0; offset < info.imageSize; offset += sizeof(buffer) )
+				{
+					size_t size = info.imageSize - offset < sizeof(buffer) ? info.imageSize - offset : sizeof(buffer);
+
+					if ( _cache.read(entry, offset, buffer, size) != ESP_OK )
+					{
+						return false;
+					}
+
+					crc = esp_rom_crc32_le(crc, buffer, size);
+				}
+
+				return crc == info.imageCRC;
+			}
+
+			void iteration(uint32_t index)
+			{
+				Scenario scenario = static_cast<Scenario>(_random.below(static_cast<uint32_t>(Scenario::Count)));
+				size_t payloadSize = _random.between(MIN_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+				std::vector<uint8_t> image = buildImage(_random, payloadSize, scenario == Scenario::BadSignature ? WRONG_KEY : SIGNING_KEY);
+
+				Options options = randomOptions();
+				options.unknownLength = options.unknownLength || scenario == Scenario::UnknownLength;
+
+				FakeFirmwareSource source(image, _random.next());
+				source.setFaults(faultsFor(scenario, image.size()));
+
+				const esp_partition_t* bootBefore = FakeFlash::bootPartition();
+				CacheState cacheBefore = cacheState();
+				const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+
+				if ( scenario == Scenario::WriteFailure )
+				{
+					FakeFlash::failWritesAt(target, _random.below(image.size()));
+				}
+
+				// roughly the flash operations of one transaction, cuts after its end just do not happen
+				uint32_t estimatedOperations = image.size() / SPI_FLASH_SEC_SIZE + image.size() / options.buffer.maxReadSize + 8;
+
+				if ( scenario == Scenario::PowerCut )
+				{
+					FakeFlash::powerCutAtOperation(_random.between(1, estimatedOperations));
+				}
+
+				int64_t start = FakeClock::now();
+				int64_t recoveryStart = 0;
+				size_t deliveredBeforeRecovery = 0;
+				bool resume = false;
+				bool resumed = false;
+				bool installed = false;
+				int powerCuts = 0;
+
+				for ( int attempt = 0; attempt < MAX_ATTEMPTS; attempt++ )
+				{
+					try
+					{
+						Result result = runUpdate(source, image.size(), options, resume);
+						resumed = resume && result != Result::NotResumed;
+
+						if ( result == Result::NotResumed )
+						{
+							result = runUpdate(source, image.size(), options, false);
+						}
+
+						installed = result == Result::Installed;
+						break;
+					}
+					catch ( const PowerCut& )
+					{
+						powerCuts++;
+
+						FakeFlash::reboot();
+						HarnessUpdater::simulateReboot();
+
+						_cache = FirmwareImageCache();
+						CHECK(_cache.begin("fota_cache"), "no image cache partition");
+
+						// whatever was interrupted, the device has to come up with a complete image
+						const esp_partition_t* boot = FakeFlash::bootPartition();
+						CHECK(boot == bootBefore || (boot == target && partitionHolds(target, image)),
+							  "iteration %u: boots an incomplete image after a power cut", index);
+						CHECK(partitionHolds(bootBefore, _bootImage) || boot == target,
+							  "iteration %u: power cut destroyed the boot image", index);
+
+						recoveryStart = FakeClock::now();
+						deliveredBeforeRecovery = source.stats().deliveredBytes;
+						resume = options.resumable;
+
+						if ( powerCuts < MAX_POWER_CUTS && _random.chance(25) )
+						{
+							FakeFlash::powerCutAtOperation(_random.between(1, estimatedOperations));
+						}
+					}
+				}
+
+				FakeFlash::clearFaults();
+
+				ScenarioStats& stats = _scenarioStats[static_cast<size_t>(scenario)];
+				stats.runs++;
+				stats.totalUs += FakeClock::now() - start;
+
+				CHECK(installed == expectInstalled(scenario), "iteration %u (%s, %u bytes): %s", index, SCENARIO_NAMES[static_cast<size_t>(scenario)],
+					  static_cast<unsigned>(image.size()), installed ? "bad image was installed" : "update failed");
+
+				CacheState cacheAfter = cacheState();
+				bool cacheUnchanged = cacheAfter.latest == cacheBefore.latest && cacheAfter.previous == cacheBefore.previous;
+
+				CHECK(cacheEntryIntact(FirmwareImageCache::Entry::Latest) && cacheEntryIntact(FirmwareImageCache::Entry::Previous),
+					  "iteration %u: cached image damaged", index);
+
+				if ( installed )
+				{
+					uint32_t imageCRC = esp_rom_crc32_le(0, image.data(), image.size());
+
+					// resumed updates and power cuts before the commit leave the cache as it was
+					CHECK(cacheUnchanged || (cacheAfter.latest == imageCRC && cacheAfter.previous == cacheBefore.latest),
+						  "iteration %u: cache entries do not follow the installed image", index);
+					_cachedInstalls += cacheUnchanged ? 0 : 1;
+
+					stats.installed++;
+					_installs++;
+
+					CHECK(FakeFlash::bootPartition() == target, "iteration %u: boot partition not switched", index);
+					CHECK(partitionHolds(target, image), "iteration %u: boot partition does not hold the new image", index);
+
+					if ( powerCuts > 0 )
+					{
+						// a resumable update whose resumeUpdate failed started from zero again
+						RecoveryStats& recovery = resumed ? _resumed : options.resumable ? _notResumed : _restarted;
+						recovery.add(FakeClock::now() - recoveryStart, source.stats().deliveredBytes - deliveredBeforeRecovery, image.size());
+					}
+
+					// boot the new image, the next update goes to the other partition
+					FakeFlash::reboot();
+					_bootImage = image;
+				}
+				else
+				{
+					CHECK(FakeFlash::bootPartition() == bootBefore, "iteration %u: boot partition switched by a failed update", index);
+					CHECK(partitionHolds(bootBefore, _bootImage), "iteration %u: failed update damaged the boot image", index);
+					CHECK(cacheUnchanged, "iteration %u: failed update changed the cached images", index);
+				}
+			}
+
+			void report() const
+			{
+				printf("%-16s %6s %9s %12s\n", "scenario", "runs", "installed", "avg time");
+
+				for ( size_t i = 0; i < static_cast<size_t>(Scenario::Count); i++ )
+				{
+					const ScenarioStats& stats = _scenarioStats[i];
+					printf("%-16s %6u %9u %10.2f s\n", SCENARIO_NAMES[i], stats.runs, stats.installed, stats.runs > 0 ? stats.totalUs / 1e6 / stats.runs : 0.0);
+				}
+
+				printf("recovery after power cuts (virtual time from the reboot until the new image is installed):\n");
+				_resumed.print("resumed");
+				_notResumed.print("not resumed");
+				_restarted.print("restarted");
+				printf("image cache: %u of %u installed images cached\n", _cachedInstalls, _installs);
+			}
+
+			Random					_random;
+			std::vector<uint8_t>	_bootImage;
+			FirmwareImageCache		_cache;
+			uint32_t				_installs = { 0 };
+			uint32_t				_cachedInstalls = { 0 };
+			ScenarioStats			_scenarioStats[static_cast<size_t>(Scenario::Count)];
+			RecoveryStats			_resumed;
+			RecoveryStats			_notResumed;		///< resumable, but resumeUpdate failed
+			RecoveryStats			_restarted;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 2000;
+	uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 0x2109;
+
+	printf("soak: %u iterations, seed %u\n", iterations, seed);
+
+	Soak soak(seed);
+	soak.run(iterations);
+
+	printf("soak: all ok\n");
+	return 0;
+}
@@ -0,0 +1,477 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeClock.h"
+#include "fakes/FakeFirmwareSource.h"
+#include "fakes/FakeHTTPClient.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/MemoryWriter.h"
+
+#include "FirmwareTransfer.h"
+#include "FileFirmwareSource.h"
+#include "HTTPFirmwareDownloader.h"
+#include "HTTPFirmwareSource.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <vector>
+
+/*
+ * Tests of FirmwareTransfer behavior that the soak test does not check on its own.
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::FirmwareTransfer;
+using IDFix::FOTA::FileFirmwareSource;
+using IDFix::FOTA::HTTPFirmwareDownloader;
+using IDFix::FOTA::HTTPFirmwareSource;
+
+namespace
+{
+	std::vector<uint8_t> testImage(size_t size)
+	{
+		std::vector<uint8_t> image(size);
+
+		for ( size_t i = 0; i < size; i++ )
+		{
+			image[i] = static_cast<uint8_t>(i * 7);
+		}
+
+		return image;
+	}
+
+	/* the finished callback of a background transfer may delete the transfer */
+	void testBackgroundCallbackDeletesTransfer()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+		std::promise<int> finished;
+
+		FirmwareTransfer* transfer = new FirmwareTransfer();
+		transfer->setFirmwareSource(&source);
+		transfer->setFirmwareWriter(&writer);
+
+		bool started = transfer->startBackgroundTransfer(1, tskNO_AFFINITY, [&](int result)
+		{
+			CHECK(transfer->isBackgroundTransferRunning() == false, "transfer still running in its finished callback");
+			delete transfer;
+			finished.set_value(result);
+		});
+
+		CHECK(started, "background transfer not started");
+
+		std::future<int> result = finished.get_future();
+		CHECK(result.wait_for(std::chrono::seconds(10)) == std::future_status::ready, "background transfer did not finish");
+		CHECK(result.get() == 0, "background transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+		CHECK(FakeTasks::lastStackSize() == FirmwareTransfer::DEFAULT_BACKGROUND_STACK_SIZE, "task started with %u bytes of stack", FakeTasks::lastStackSize());
+	}
+
+	/* the stack of the background task is sized by the caller */
+	void testBackgroundStackSize()
+	{
+		std::vector<uint8_t> image = testImage(4096);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+		std::promise<int> finished;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.startBackgroundTransfer(1, tskNO_AFFINITY, [&](int result) { finished.set_value(result); }, 12288), "background transfer not started");
+		CHECK(finished.get_future().get() == 0, "background transfer failed");
+		CHECK(FakeTasks::lastStackSize() == 12288, "task started with %u bytes of stack", FakeTasks::lastStackSize());
+	}
+
+	/* a cancel right after the start is not lost, even if the task did not run yet */
+	void testCancelBeforeBackgroundTaskRuns()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+		std::promise<int> finished;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		FakeTasks::holdTasks();
+		CHECK(transfer.startBackgroundTransfer(1, tskNO_AFFINITY, [&](int result) { finished.set_value(result); }), "background transfer not started");
+		CHECK(transfer.getState() == FirmwareTransfer::State::Running, "state %d after the start", static_cast<int>(transfer.getState()));
+		transfer.cancel();
+		FakeTasks::startHeldTasks();
+
+		CHECK(finished.get_future().get() != 0, "cancelled transfer succeeded");
+		CHECK(transfer.getState() == FirmwareTransfer::State::Cancelled, "state %d", static_cast<int>(transfer.getState()));
+		CHECK(source.stats().opens == 0, "source opened %u times", source.stats().opens);
+		CHECK(writer.data().empty(), "%u bytes written", static_cast<unsigned>(writer.data().size()));
+	}
+
+	/* cancel closes a step driven transfer at the next step, the next transfer is not cancelled */
+	void testCancelStepDriven()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+		int finishedResult = 1;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.beginTransfer([&](int result) { finishedResult = result; }), "transfer not started");
+		CHECK(transfer.step() == FirmwareTransfer::State::Running, "first step did not transfer");
+
+		transfer.cancel();
+		CHECK(transfer.step() == FirmwareTransfer::State::Cancelled, "state %d after cancel", static_cast<int>(transfer.getState()));
+		CHECK(finishedResult == -1, "finished callback reported %d", finishedResult);
+		CHECK(source.isOpen() == false, "source still open");
+		CHECK(writer.data().size() < image.size(), "cancelled transfer wrote the whole image");
+
+		MemoryWriter nextWriter;
+		transfer.setFirmwareWriter(&nextWriter);
+		CHECK(transfer.transferFirmware() == 0, "transfer after a cancelled one failed");
+		CHECK(nextWriter.data() == image, "written data differs from the image");
+	}
+
+	/* deleting an open step driven transfer closes the source and frees the read buffer */
+	void testDeleteOpenTransfer()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+		bool finished = false;
+
+		FirmwareTransfer* transfer = new FirmwareTransfer();
+		transfer->setFirmwareSource(&source);
+		transfer->setFirmwareWriter(&writer);
+
+		CHECK(transfer->beginTransfer([&](int) { finished = true; }), "transfer not started");
+		CHECK(transfer->step() == FirmwareTransfer::State::Running, "first step did not transfer");
+		delete transfer;
+
+		CHECK(source.isOpen() == false, "source still open");
+		CHECK(finished == false, "finished callback called from the destructor");
+
+		FakeHTTPClient::reset();
+		FakeHTTPClient::serve(image);
+
+		esp_http_client_config_t config = {};
+		config.url = "http://host/firmware.bin";
+
+		HTTPFirmwareDownloader* downloader = new HTTPFirmwareDownloader();
+		downloader->setFirmwareWriter(&writer);
+
+		CHECK(downloader->beginDownload(&config), "download not started");
+		CHECK(downloader->step() == FirmwareTransfer::State::Running, "first step did not transfer");
+		delete downloader;
+
+		CHECK(FakeHTTPClient::stats().cleanups == FakeHTTPClient::stats().inits, "%u of %u HTTP clients cleaned up",
+			  FakeHTTPClient::stats().cleanups, FakeHTTPClient::stats().inits);
+	}
+
+	/* a source that returns at once without data must not be polled in a busy loop */
+	void testStalledSourceIsNotPolledInALoop()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+
+		FakeFirmwareSource::Faults faults;
+		faults.stallAt = 20000;
+		faults.stallUs = 2000000;
+		source.setFaults(faults);
+
+		FakeFirmwareSource::Timing timing;
+		timing.emptyReadUs = 0;
+		source.setTiming(timing);
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+		CHECK(source.stats().emptyReads < 400, "%u reads during a stall of 2 s", source.stats().emptyReads);
+	}
+
+	/* a non blocking stream without end of file ends after the idle time, read with the size the source prefers */
+	void testFileDescriptorIdleEnd()
+	{
+		std::vector<uint8_t> image = testImage(48 * 1024);
+		int pipeFds[2];
+
+		CHECK(pipe(pipeFds) == 0, "no pipe");
+		CHECK(fcntl(pipeFds[0], F_SETFL, O_NONBLOCK) == 0, "pipe stays blocking");
+		CHECK(write(pipeFds[1], image.data(), image.size()) == static_cast<ssize_t>(image.size()), "pipe too small");
+
+		FileFirmwareSource source;
+		source.setFileDescriptor(pipeFds[0], 0, 200);
+		MemoryWriter writer;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		// the write end stays open, the stream never reports its end
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+		CHECK(transfer.getStats().maxReadSize == source.preferredReadSize(), "read size %u, the source prefers %u",
+			  static_cast<unsigned>(transfer.getStats().maxReadSize), static_cast<unsigned>(source.preferredReadSize()));
+
+		close(pipeFds[0]);
+		close(pipeFds[1]);
+	}
+
+	/* a source whose cost grows with the size only, gains nothing from a larger buffer, so it is given back */
+	void testReadSizeStaysWithoutGain()
+	{
+		std::vector<uint8_t> image = testImage(256 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+
+		const FirmwareTransfer::Stats& stats = transfer.getStats();
+		CHECK(stats.maxReadSize <= 2 * stats.minReadSize, "read size grew from %u to %u without any gain",
+			  static_cast<unsigned>(stats.minReadSize), static_cast<unsigned>(stats.maxReadSize));
+		CHECK(stats.readSize == stats.minReadSize, "read size %u kept after the trial", static_cast<unsigned>(stats.readSize));
+	}
+
+	/* a fixed cost per read makes larger reads faster, the read size grows up to the limit */
+	void testReadSizeGrowsWithPerReadCost()
+	{
+		std::vector<uint8_t> image = testImage(256 * 1024);
+		FakeFirmwareSource source(image);
+		MemoryWriter writer;
+
+		FakeFirmwareSource::Timing timing;
+		timing.usPerKiB = 100;
+		timing.perReadUs = 2000;
+		source.setTiming(timing);
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+		CHECK(transfer.getStats().readSize == FirmwareTransfer::BufferConfig().maxReadSize, "read size %u",
+			  static_cast<unsigned>(transfer.getStats().readSize));
+	}
+
+	/* the http source raises the receive buffer of the client, the IDF default reads the transport in 512 byte pieces */
+	void testHTTPReceiveBuffer()
+	{
+		std::vector<uint8_t> image = testImage(128 * 1024);
+		FakeHTTPClient::reset();
+		FakeHTTPClient::serve(image);
+
+		esp_http_client_config_t config = {};
+		config.url = "http://host/firmware.bin";
+
+		HTTPFirmwareSource source;
+		source.setHTTPConfig(&config);
+		MemoryWriter writer;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+		CHECK(config.buffer_size == 0, "the configuration of the caller was changed");
+		CHECK(FakeHTTPClient::stats().lastBufferSize >= 4096, "client buffer of %d bytes", FakeHTTPClient::stats().lastBufferSize);
+		CHECK(FakeHTTPClient::stats().transportReads <= image.size() / 4096 + 1, "%u transport reads", FakeHTTPClient::stats().transportReads);
+	}
+
+	/* a resumed download requests the rest of the image and fails if the server sends the whole image instead */
+	void testHTTPRangeRequest()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+		std::vector<uint8_t> rest(image.begin() + 40000, image.end());
+		esp_http_client_config_t config = {};
+		config.url = "http://host/firmware.bin";
+
+		for ( bool supportsRanges : { true, false } )
+		{
+			FakeHTTPClient::reset();
+			FakeHTTPClient::serve(image, 200, supportsRanges);
+
+			HTTPFirmwareSource source;
+			source.setHTTPConfig(&config);
+			MemoryWriter writer;
+
+			FirmwareTransfer transfer;
+			transfer.setFirmwareSource(&source);
+			transfer.setFirmwareWriter(&writer);
+			transfer.setSourceOffset(40000);
+
+			int result = transfer.transferFirmware();
+			CHECK(FakeHTTPClient::stats().lastRangeStart == 40000, "range request for %d", FakeHTTPClient::stats().lastRangeStart);
+
+			if ( supportsRanges )
+			{
+				CHECK(result == 0, "transfer failed");
+				CHECK(writer.data() == rest, "written data differs from the rest of the image");
+			}
+			else
+			{
+				CHECK(result != 0, "transfer of the whole image at an offset succeeded");
+				CHECK(writer.data().empty(), "%u bytes written", static_cast<unsigned>(writer.data().size()));
+			}
+		}
+	}
+
+	/* a file is read from the offset, a pipe cannot start there */
+	void testFileOffset()
+	{
+		std::vector<uint8_t> image = testImage(48 * 1024);
+		std::vector<uint8_t> rest(image.begin() + 20000, image.end());
+
+		char path[] = "/tmp/idfix-fota-XXXXXX";
+		int fd = mkstemp(path);
+		CHECK(fd >= 0, "no temporary file");
+		CHECK(write(fd, image.data(), image.size()) == static_cast<ssize_t>(image.size()), "temporary file not written");
+		close(fd);
+
+		FileFirmwareSource fileSource;
+		fileSource.setPath(path);
+		MemoryWriter fileWriter;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&fileSource);
+		transfer.setFirmwareWriter(&fileWriter);
+		transfer.setSourceOffset(20000);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(fileWriter.data() == rest, "written data differs from the rest of the image");
+		CHECK(transfer.transferFirmware() == 0, "second transfer failed");
+		CHECK(fileWriter.data().size() == rest.size() + image.size(), "the offset applied to the second transfer too");
+		unlink(path);
+
+		int pipeFds[2];
+		CHECK(pipe(pipeFds) == 0, "no pipe");
+		CHECK(write(pipeFds[1], image.data(), 4096) == 4096, "pipe too small");
+		close(pipeFds[1]);
+
+		FileFirmwareSource pipeSource;
+		pipeSource.setFileDescriptor(pipeFds[0]);
+		MemoryWriter pipeWriter;
+		transfer.setFirmwareSource(&pipeSource);
+		transfer.setFirmwareWriter(&pipeWriter);
+		transfer.setSourceOffset(1000);
+
+		CHECK(transfer.transferFirmware() != 0, "pipe opened at an offset");
+		CHECK(pipeWriter.data().empty(), "%u bytes written", static_cast<unsigned>(pipeWriter.data().size()));
+		close(pipeFds[0]);
+	}
+
+	/* a descriptor is read from its current position up to the length the caller passed */
+	void testFileDescriptorPosition()
+	{
+		std::vector<uint8_t> header(100, 0x5a);
+		std::vector<uint8_t> image = testImage(48 * 1024);
+		std::vector<uint8_t> trailer(3000, 0xa5);
+
+		char path[] = "/tmp/idfix-fota-XXXXXX";
+		int fd = mkstemp(path);
+		CHECK(fd >= 0, "no temporary file");
+		CHECK(write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size()), "temporary file not written");
+		CHECK(write(fd, image.data(), image.size()) == static_cast<ssize_t>(image.size()), "temporary file not written");
+		CHECK(write(fd, trailer.data(), trailer.size()) == static_cast<ssize_t>(trailer.size()), "temporary file not written");
+		unlink(path);
+
+		// the caller read the header, the trailer is not part of the image
+		CHECK(lseek(fd, header.size(), SEEK_SET) == static_cast<off_t>(header.size()), "cannot seek");
+
+		FileFirmwareSource source;
+		source.setFileDescriptor(fd, image.size());
+
+		// the mapping starts within a page
+		const void* data = nullptr;
+		CHECK(source.open(0), "source not opened");
+		CHECK(source.supportsDirectRead(), "the file was not mapped");
+		CHECK(source.contentLength() == static_cast<int>(image.size()), "content length %d", source.contentLength());
+		CHECK(source.readDirect(&data, 256) == 256 && memcmp(data, image.data(), 256) == 0, "the mapping does not start at the image");
+		source.close();
+
+		MemoryWriter writer;
+
+		FirmwareTransfer transfer;
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&writer);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(writer.data() == image, "written data differs from the image");
+
+		std::vector<uint8_t> rest(image.begin() + 20000, image.end());
+		MemoryWriter offsetWriter;
+		transfer.setFirmwareWriter(&offsetWriter);
+		transfer.setSourceOffset(20000);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer at an offset failed");
+		CHECK(offsetWriter.data() == rest, "written data differs from the rest of the image");
+
+		// without a length the image runs to the end of the file
+		std::vector<uint8_t> tail(image);
+		tail.insert(tail.end(), trailer.begin(), trailer.end());
+		CHECK(lseek(fd, header.size(), SEEK_SET) == static_cast<off_t>(header.size()), "cannot seek");
+		source.setFileDescriptor(fd);
+		MemoryWriter tailWriter;
+		transfer.setFirmwareWriter(&tailWriter);
+		transfer.setSourceOffset(0);
+
+		CHECK(transfer.transferFirmware() == 0, "transfer without a length failed");
+		CHECK(tailWriter.data() == tail, "written data differs from the rest of the file");
+
+		source.close();
+		close(fd);
+	}
+}
+
+int main()
+{
+	testBackgroundCallbackDeletesTransfer();
+	testBackgroundStackSize();
+	testCancelBeforeBackgroundTaskRuns();
+	testCancelStepDriven();
+	testDeleteOpenTransfer();
+	testStalledSourceIsNotPolledInALoop();
+	testFileDescriptorIdleEnd();
+	testReadSizeStaysWithoutGain();
+	testReadSizeGrowsWithPerReadCost();
+	testHTTPReceiveBuffer();
+	testHTTPRangeRequest();
+	testFileOffset();
+	testFileDescriptorPosition();
+
+	printf("transfer: all ok\n");
+	return 0;
+}
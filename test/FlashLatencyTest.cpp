@@ -0,0 +1,120 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeClock.h"
+#include "fakes/FakeFlash.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/FakeFirmwareSource.h"
+#include "fakes/HarnessUpdater.h"
+
+#include "FirmwareTransfer.h"
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * Compares how long a competing task that needs the flash (on the device: the cache) has to wait at most
+ * while an update is written. The flash fake models erase and write times on the virtual clock, the longest
+ * single flash operation is the worst case wait of such a task - deterministic, independent of the scheduler.
+ *
+ * Erasing the whole partition in beginUpdate keeps the flash busy for whole 64 KiB block erases and can
+ * not be throttled, with OTA_WITH_SEQUENTIAL_WRITES only single sectors are erased between throttled writes.
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::FirmwareTransfer;
+
+namespace
+{
+	const size_t	IMAGE_SIZE			= 256 * 1024;
+
+	struct Measurement
+	{
+		int64_t		beginUs;
+		int64_t		totalUs;
+		int64_t		worstUs;
+	};
+
+	Measurement measureUpdate(const std::vector<uint8_t>& image, size_t imageSize, uint8_t writeDutyCyclePercent)
+	{
+		FakeFlash::reset();
+
+		FakeFirmwareSource source(image);
+		FakeFirmwareSource::Timing sourceTiming;
+		sourceTiming.usPerKiB = 0;
+		source.setTiming(sourceTiming);
+
+		FirmwareTransfer::ThrottleConfig throttle;
+		throttle.writeDutyCyclePercent = writeDutyCyclePercent;
+
+		HarnessUpdater updater;
+		FirmwareTransfer transfer;
+		transfer.setThrottle(throttle);
+		transfer.setFirmwareSource(&source);
+		transfer.setFirmwareWriter(&updater);
+
+		Measurement measurement;
+
+		int64_t start = FakeClock::now();
+		CHECK(updater.beginUpdate(imageSize), "beginUpdate failed");
+		measurement.beginUs = FakeClock::now() - start;
+
+		CHECK(transfer.transferFirmware() == 0, "transfer failed");
+		CHECK(updater.finishUpdate(), "finishUpdate failed");
+		measurement.totalUs = FakeClock::now() - start;
+		measurement.worstUs = FakeFlash::stats().longestOperationUs;
+
+		CHECK(FakeFlash::read(FakeFlash::bootPartition(), 0, image.size()) == image, "image not installed");
+
+		return measurement;
+	}
+
+	void print(const char* name, const Measurement& measurement)
+	{
+		printf("%-34s beginUpdate %6.1f ms, update %6.1f ms, competing task waits up to %5.1f ms\n", name,
+			   measurement.beginUs / 1e3, measurement.totalUs / 1e3, measurement.worstUs / 1e3);
+	}
+}
+
+int main()
+{
+	// scaled down by about ten from a typical SPI flash, the ratio of block to sector erase is kept
+	FakeFlash::Timing timing;
+	timing.sectorEraseUs = 4000;
+	timing.blockEraseUs = 15000;
+	timing.writeUsPerKiB = 100;
+	FakeFlash::setTiming(timing);
+
+	// unsigned image, it ends with a signature length of 0
+	std::vector<uint8_t> image(IMAGE_SIZE, 0x5A);
+	image[0] = 0xE9;
+	std::fill(image.end() - sizeof(uint32_t), image.end(), 0);
+
+	Measurement fullErase = measureUpdate(image, OTA_SIZE_UNKNOWN, 100);
+	Measurement sequential = measureUpdate(image, OTA_WITH_SEQUENTIAL_WRITES, 50);
+
+	print("erase partition in beginUpdate", fullErase);
+	print("OTA_WITH_SEQUENTIAL_WRITES, 50 %", sequential);
+
+	CHECK(sequential.beginUs < fullErase.beginUs, "sequential writes still erase in beginUpdate");
+	CHECK(fullErase.worstUs == timing.blockEraseUs, "erasing in beginUpdate does not erase whole blocks");
+	CHECK(sequential.worstUs < fullErase.worstUs, "sequential writes do not lower the worst case latency");
+
+	printf("latency: all ok\n");
+	return 0;
+}
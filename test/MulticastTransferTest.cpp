@@ -0,0 +1,436 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "fakes/FakeClock.h"
+#include "fakes/FakeFlash.h"
+#include "fakes/FakePlatform.h"
+#include "fakes/HarnessUpdater.h"
+#include "fakes/MemoryWriter.h"
+#include "fakes/TestCrypto.h"
+
+#include "MulticastFirmwareReceiver.h"
+#include "MulticastFirmwareSeeder.h"
+
+extern "C"
+{
+	#include <arpa/inet.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/*
+ * Multicast distribution over the loopback interface. recvfrom is wrapped at link time to drop packets
+ * received on the multicast port, so FEC recovery and repair requests run against a lossy network.
+ * The received images are written to memory, or through FirmwareUpdater to the flash fake and installed.
+ */
+
+using namespace HostTest;
+using namespace IDFix::FOTA;
+
+namespace
+{
+	const char*		GROUP_ADDRESS			= "239.255.77.1";
+	const char*		LOOPBACK_ADDRESS		= "127.0.0.1";
+	const uint16_t	PORT					= 45683;
+	const uint32_t	MAX_IMAGE_SIZE			= 1024 * 1024;
+	const int		SKIPPED					= 77;
+	const char		MAGIC_BYTES[]			= "IDFIXFW1";
+	const size_t	MAGIC_LENGTH			= sizeof(MAGIC_BYTES) - 1;
+	const uint8_t	SIGNING_KEY				= 0x5A;
+
+	std::atomic<uint32_t>	lossPercent(0);
+	std::atomic<uint32_t>	droppedPackets(0);
+	uint32_t				lossRandom = 0x2109;
+
+	uint16_t localPort(int fd)
+	{
+		sockaddr_in address = {};
+		socklen_t length = sizeof(address);
+
+		if ( getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0 )
+		{
+			return 0;
+		}
+
+		return ntohs(address.sin_port);
+	}
+
+	bool dropPacket()
+	{
+		// xorshift32, only the receiving thread gets here
+		lossRandom ^= lossRandom << 13;
+		lossRandom ^= lossRandom >> 17;
+		lossRandom ^= lossRandom << 5;
+		return lossRandom % 100 < lossPercent;
+	}
+
+	std::vector<uint8_t> testImage(size_t size)
+	{
+		std::vector<uint8_t> image(size);
+		uint32_t state = 0x5A5A;
+
+		for ( uint8_t& byte : image )
+		{
+			state = state * 1103515245 + 12345;
+			byte = static_cast<uint8_t>(state >> 16);
+		}
+
+		return image;
+	}
+
+	int openGroupSocket(int timeoutMs)
+	{
+		int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		int reuse = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in local = {};
+		local.sin_family = AF_INET;
+		local.sin_port = htons(PORT);
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		ip_mreq membership = {};
+		inet_aton(GROUP_ADDRESS, &membership.imr_multiaddr);
+		inet_aton(LOOPBACK_ADDRESS, &membership.imr_interface);
+
+		timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		if ( bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0
+			 || setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0 )
+		{
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	int openSenderSocket()
+	{
+		int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		in_addr interface;
+		inet_aton(LOOPBACK_ADDRESS, &interface);
+		setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+		return fd;
+	}
+
+	sockaddr_in groupDestination()
+	{
+		sockaddr_in destination = {};
+		destination.sin_family = AF_INET;
+		destination.sin_port = htons(PORT);
+		inet_aton(GROUP_ADDRESS, &destination.sin_addr);
+		return destination;
+	}
+
+	bool multicastAvailable()
+	{
+		int receiver = openGroupSocket(1000);
+
+		if ( receiver < 0 )
+		{
+			return false;
+		}
+
+		int sender = openSenderSocket();
+		sockaddr_in destination = groupDestination();
+		sendto(sender, "probe", 5, 0, reinterpret_cast<sockaddr*>(&destination), sizeof(destination));
+
+		char buffer[16];
+		bool received = recv(receiver, buffer, sizeof(buffer), 0) == 5;
+
+		close(sender);
+		close(receiver);
+		return received;
+	}
+
+	/* the whole image arrives although every tenth packet is lost */
+	void testTransferWithLoss()
+	{
+		std::vector<uint8_t> image = testImage(192 * 1024 + 123);
+
+		MulticastFirmwareReceiver receiver;
+		CHECK(receiver.begin(GROUP_ADDRESS, PORT, MAX_IMAGE_SIZE, LOOPBACK_ADDRESS), "receiver not started");
+
+		MulticastFirmwareSeeder seeder;
+		CHECK(seeder.begin(GROUP_ADDRESS, PORT, 1, LOOPBACK_ADDRESS), "seeder not started");
+		seeder.setImage(image.data(), image.size(), 0x1234);
+		seeder.setPacketInterval(100);
+
+		std::atomic<bool> done(false);
+		std::thread seederThread([&]()
+		{
+			for ( int round = 0; round < 20 && done == false; round++ )
+			{
+				seeder.sendRound();
+				seeder.serveRepairs(300);
+			}
+		});
+
+		MemoryWriter writer;
+		receiver.setFirmwareWriter(&writer);
+		droppedPackets = 0;
+		lossPercent = 10;
+
+		int result = receiver.receiveFirmware(5000);
+
+		lossPercent = 0;
+		done = true;
+		seederThread.join();
+
+		const MulticastFirmwareReceiver::Stats& stats = receiver.getStats();
+		printf("  %u packets dropped, %u chunks received, %u recovered from parity, %u repair requests, %u repairs answered\n",
+			   droppedPackets.load(), stats.receivedChunks, stats.recoveredChunks, stats.repairRequests, seeder.getStats().answeredRepairs);
+
+		CHECK(result == 0, "image not received");
+		CHECK(writer.data() == image, "received image differs");
+		CHECK(droppedPackets > 0, "no packet dropped");
+		CHECK(stats.recoveredChunks > 0, "nothing recovered from parity");
+	}
+
+	/* payload | magic bytes | signature | signature length */
+	std::vector<uint8_t> signedImage(size_t payloadSize)
+	{
+		std::vector<uint8_t> image = testImage(payloadSize);
+		image[0] = 0xE9;
+		image.insert(image.end(), MAGIC_BYTES, MAGIC_BYTES + MAGIC_LENGTH);
+
+		std::vector<uint8_t> signature = TestVerifier::sign(TestHash::digest(image.data(), image.size()), SIGNING_KEY);
+		uint32_t signatureLength = signature.size();
+
+		image.insert(image.end(), signature.begin(), signature.end());
+		image.insert(image.end(), reinterpret_cast<uint8_t*>(&signatureLength), reinterpret_cast<uint8_t*>(&signatureLength) + sizeof(signatureLength));
+
+		return image;
+	}
+
+	/* received out of order through a lossy network, the image is installed only if its signature matches */
+	void testInstallThroughUpdater()
+	{
+		std::vector<uint8_t> image = signedImage(160 * 1024 + 77);
+		std::vector<uint8_t> corrupted = image;
+		corrupted[100 * 1024] ^= 0x04;
+
+		for ( const std::vector<uint8_t>* sent : { &image, &corrupted } )
+		{
+			bool intact = sent == &image;
+
+			FakeFlash::reset();
+			FakeNVS::clear();
+			const esp_partition_t* bootBefore = FakeFlash::bootPartition();
+
+			MulticastFirmwareReceiver receiver;
+			CHECK(receiver.begin(GROUP_ADDRESS, PORT, MAX_IMAGE_SIZE, LOOPBACK_ADDRESS), "receiver not started");
+
+			MulticastFirmwareSeeder seeder;
+			CHECK(seeder.begin(GROUP_ADDRESS, PORT, 1, LOOPBACK_ADDRESS), "seeder not started");
+			seeder.setImage(sent->data(), sent->size(), intact ? 0x2001 : 0x2002);
+			seeder.setPacketInterval(100);
+
+			std::atomic<bool> done(false);
+			std::thread seederThread([&]()
+			{
+				for ( int round = 0; round < 20 && done == false; round++ )
+				{
+					seeder.sendRound();
+					seeder.serveRepairs(300);
+				}
+			});
+
+			TestHash hash;
+			TestVerifier verifier(SIGNING_KEY);
+			HarnessUpdater updater;
+			updater.setMagicBytes(MAGIC_BYTES, MAGIC_LENGTH);
+			updater.installSignatureVerifier(&verifier, &hash);
+
+			droppedPackets = 0;
+			lossPercent = 10;
+
+			// as documented for MulticastFirmwareReceiver, the chunks go to writeFirmwareBytesAt
+			CHECK(receiver.waitForSession(5000), "no session");
+			CHECK(receiver.getImageSize() == sent->size(), "session of %u bytes", receiver.getImageSize());
+			CHECK(updater.beginUpdate(receiver.getImageSize()), "beginUpdate failed");
+			receiver.setFirmwareWriter(&updater);
+
+			int result = receiver.receiveFirmware(5000);
+			bool installed = result == 0 && updater.finishUpdate();
+
+			if ( result != 0 )
+			{
+				updater.abortUpdate();
+			}
+
+			lossPercent = 0;
+			done = true;
+			seederThread.join();
+
+			CHECK(result == 0, "image not received");
+			CHECK(droppedPackets > 0, "no packet dropped");
+
+			if ( intact )
+			{
+				CHECK(installed, "received image not installed");
+				CHECK(FakeFlash::bootPartition() != bootBefore, "boot partition not switched");
+				CHECK(FakeFlash::read(FakeFlash::bootPartition(), 0, image.size()) == image, "boot partition does not hold the image");
+			}
+			else
+			{
+				CHECK(installed == false, "corrupted image installed");
+				CHECK(FakeFlash::bootPartition() == bootBefore, "boot partition switched to a corrupted image");
+			}
+		}
+	}
+
+	/* empty, oversized and foreign packets neither start a session nor shorten the wait for one */
+	void testSessionBounds()
+	{
+		MulticastFirmwareReceiver receiver;
+		CHECK(receiver.begin(GROUP_ADDRESS, PORT, MAX_IMAGE_SIZE, LOOPBACK_ADDRESS), "receiver not started");
+
+		std::atomic<bool> done(false);
+		std::thread sender([&]()
+		{
+			int fd = openSenderSocket();
+			sockaddr_in destination = groupDestination();
+			uint8_t packet[sizeof(Multicast::PacketHeader) + 256] = {};
+			uint32_t imageSizes[] = { 0, MAX_IMAGE_SIZE + 1, 0xFFFFFFFF };
+
+			for ( uint32_t i = 0; done == false; i++ )
+			{
+				if ( i % 4 == 3 )
+				{
+					memset(packet, 0xA5, sizeof(Multicast::PacketHeader));
+				}
+				else
+				{
+					Multicast::encodeHeader(reinterpret_cast<Multicast::PacketHeader*>(packet), Multicast::PacketType::Data, 16, 256, 0x4711, imageSizes[i % 4], 0);
+				}
+
+				sendto(fd, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&destination), sizeof(destination));
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+
+			close(fd);
+		});
+
+		int64_t start = FakeClock::now();
+		bool joined = receiver.waitForSession(800);
+		int64_t waitedUs = FakeClock::now() - start;
+
+		done = true;
+		sender.join();
+
+		CHECK(joined == false, "joined a session of %u bytes", receiver.getImageSize());
+		CHECK(waitedUs >= 750000, "gave up after %lld ms", static_cast<long long>(waitedUs / 1000));
+	}
+
+	/* a stream of repair requests from one host is answered only within its budget, which refills over time */
+	void testRepairBudget()
+	{
+		std::vector<uint8_t> image = testImage(64 * 1024);
+
+		MulticastFirmwareSeeder seeder;
+		CHECK(seeder.begin(GROUP_ADDRESS, PORT, 1, LOOPBACK_ADDRESS), "seeder not started");
+		seeder.setImage(image.data(), image.size(), 0x1234);
+		seeder.setRepairBudget(8 * 1024, 1024 * 1024);
+
+		// learn the address of the seeder from its broadcast
+		int probe = openGroupSocket(1000);
+		CHECK(probe >= 0, "no group socket");
+		CHECK(seeder.sendRound(), "round not sent");
+
+		uint8_t packet[Multicast::MAX_PACKET_SIZE];
+		sockaddr_in seederAddress = {};
+		socklen_t addressLength = sizeof(seederAddress);
+		CHECK(recvfrom(probe, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&seederAddress), &addressLength) > 0, "no broadcast received");
+		close(probe);
+
+		int requester = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		uint8_t request[sizeof(Multicast::PacketHeader)];
+
+		auto requestRepairs = [&]()
+		{
+			for ( uint32_t i = 0; i < 200; i++ )
+			{
+				Multicast::encodeHeader(reinterpret_cast<Multicast::PacketHeader*>(request), Multicast::PacketType::RepairRequest,
+										Multicast::DEFAULT_GROUP_SIZE, Multicast::DEFAULT_CHUNK_SIZE, 0x1234, image.size(), i % 64);
+				sendto(requester, request, sizeof(request), 0, reinterpret_cast<sockaddr*>(&seederAddress), sizeof(seederAddress));
+			}
+
+			seeder.serveRepairs(200);
+		};
+
+		requestRepairs();
+
+		const MulticastFirmwareSeeder::Stats& stats = seeder.getStats();
+		uint32_t firstAnswers = stats.answeredRepairs;
+		CHECK(firstAnswers > 0 && firstAnswers <= 10, "%u of 200 requests answered with a budget of 8 KiB/s", firstAnswers);
+		CHECK(stats.answeredRepairs + stats.droppedRepairs == 200, "%u requests handled", stats.answeredRepairs + stats.droppedRepairs);
+
+		// the budget follows esp_timer_get_time, one more second refills it completely
+		FakeClock::advance(1000000);
+		requestRepairs();
+		close(requester);
+
+		uint32_t secondAnswers = stats.answeredRepairs - firstAnswers;
+		CHECK(secondAnswers >= 6 && secondAnswers <= 10, "%u of 200 requests answered after one second", secondAnswers);
+		CHECK(stats.answeredRepairs + stats.droppedRepairs == 400, "%u requests handled", stats.answeredRepairs + stats.droppedRepairs);
+	}
+}
+
+extern "C" ssize_t __real_recvfrom(int fd, void* buffer, size_t length, int flags, sockaddr* address, socklen_t* addressLength);
+
+extern "C" ssize_t __wrap_recvfrom(int fd, void* buffer, size_t length, int flags, sockaddr* address, socklen_t* addressLength)
+{
+	while ( true )
+	{
+		ssize_t received = __real_recvfrom(fd, buffer, length, flags, address, addressLength);
+
+		if ( received <= 0 || lossPercent == 0 || localPort(fd) != PORT || dropPacket() == false )
+		{
+			return received;
+		}
+
+		droppedPackets++;
+	}
+}
+
+int main()
+{
+	FakeClock::setRealTime(true);
+
+	if ( multicastAvailable() == false )
+	{
+		printf("multicast: skipped, no multicast over loopback\n");
+		return SKIPPED;
+	}
+
+	testTransferWithLoss();
+	testInstallThroughUpdater();
+	testSessionBounds();
+	testRepairBudget();
+
+	printf("multicast: all ok\n");
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SignatureTestVectors.h"
+
+#include "ECDSASignatureVerifier.h"
+
+extern "C"
+{
+	#include <mbedtls/pk.h>
+}
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Compares the verify latency of the signature schemes of FirmwareUpdater that mbedTLS implements. The hash
+ * is the same for all schemes, so only SignatureVerifier::verify is measured - the part that differs per
+ * scheme in finishUpdate. The keys and signatures are the openssl made ones of SignatureTestVectors.h.
+ * Ed25519ph has no mbedTLS implementation and is not measured. Not run by ctest, the numbers depend on the host.
+ *
+ * usage: SignatureBenchmark [iterations]
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::ECDSASignatureVerifier;
+
+namespace
+{
+	/* the RSA reference, verified through mbedtls_pk like the EC key */
+	class RSAVerifier : public IDFix::Crypto::SignatureVerifier
+	{
+		public:
+
+			RSAVerifier()
+			{
+				mbedtls_pk_init(&_key);
+			}
+
+			~RSAVerifier() override
+			{
+				mbedtls_pk_free(&_key);
+			}
+
+			bool setPublicKey(const unsigned char* key, size_t length)
+			{
+				return mbedtls_pk_parse_public_key(&_key, key, length) == 0 && mbedtls_pk_get_type(&_key) == MBEDTLS_PK_RSA;
+			}
+
+			int verify(const unsigned char* hash, size_t hashLength, const unsigned char* signature, size_t signatureLength) override
+			{
+				return mbedtls_pk_verify(&_key, MBEDTLS_MD_SHA256, hash, hashLength, signature, signatureLength);
+			}
+
+		private:
+
+			mbedtls_pk_context		_key;
+	};
+
+	void measure(const char* name, IDFix::Crypto::SignatureVerifier& verifier, const unsigned char* signature, size_t signatureLength, uint32_t iterations)
+	{
+		if ( verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), signature, signatureLength) != 0 )
+		{
+			fprintf(stderr, "%s: signature does not verify\n", name);
+			exit(1);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		for ( uint32_t i = 0; i < iterations; i++ )
+		{
+			verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), signature, signatureLength);
+		}
+
+		double totalUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		printf("%-12s %5u bytes signature %10.1f us per verify\n", name, static_cast<unsigned>(signatureLength), totalUs / iterations);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 200;
+
+	ECDSASignatureVerifier ecdsaVerifier;
+	RSAVerifier rsaVerifier;
+
+	if ( ecdsaVerifier.setPublicKey(P256_PUBLIC_KEY, sizeof(P256_PUBLIC_KEY)) == false || rsaVerifier.setPublicKey(RSA2048_PUBLIC_KEY, sizeof(RSA2048_PUBLIC_KEY)) == false )
+	{
+		fprintf(stderr, "could not set the public keys\n");
+		return 1;
+	}
+
+	printf("%u iterations\n", iterations);
+	measure("rsa-2048", rsaVerifier, RSA2048_SIGNATURE, sizeof(RSA2048_SIGNATURE), iterations);
+	measure("ecdsa-p256", ecdsaVerifier, P256_SIGNATURE, sizeof(P256_SIGNATURE), iterations);
+	printf("ed25519ph    not available in mbedTLS\n");
+
+	return 0;
+}
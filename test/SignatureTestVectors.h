@@ -0,0 +1,116 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNATURETESTVECTORS_H
+#define SIGNATURETESTVECTORS_H
+
+/*
+ * Keys and signatures generated once with the openssl command line tool, the same way fota_package.py signs:
+ *
+ *   printf 'IDFix firmware image' > message
+ *   openssl ecparam -name prime256v1 -genkey -noout -out ec.pem
+ *   openssl genpkey -algorithm RSA -pkeyopt rsa_keygen_bits:2048 -out rsa.pem
+ *   openssl pkey -in ec.pem -pubout -outform DER -out ec.der
+ *   openssl pkey -in ec.pem -pubout -out ec.pub.pem
+ *   openssl dgst -sha256 -sign ec.pem -out ec.sig message
+ *   (the same for rsa.pem)
+ */
+
+namespace HostTest
+{
+	// SHA-256 of "IDFix firmware image"
+	const unsigned char MESSAGE_SHA256[] =
+	{
+		0x40, 0x67, 0x07, 0x31, 0x2f, 0x69, 0x66, 0x01, 0xbb, 0xb4, 0xe2, 0x63, 0xb3, 0x5a, 0xc6, 0x64,
+		0x41, 0xce, 0xa1, 0x0a, 0x65, 0xf3, 0x10, 0x78, 0xf1, 0x92, 0x20, 0xb7, 0xdf, 0xbb, 0xaf, 0xf0
+	};
+
+	// DER encoded P-256 public key
+	const unsigned char P256_PUBLIC_KEY[] =
+	{
+		0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01, 0x06, 0x08, 0x2a,
+		0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0xbc, 0x17, 0x40, 0x1f, 0x83,
+		0xe8, 0x6a, 0xb4, 0x86, 0xce, 0xec, 0x01, 0x9f, 0x05, 0x56, 0x5e, 0xf2, 0xd6, 0x26, 0x06, 0xc5,
+		0x27, 0x79, 0x8d, 0xe0, 0x32, 0x67, 0xdc, 0x80, 0x81, 0x87, 0xd0, 0xe2, 0xba, 0xd9, 0xf4, 0x22,
+		0x45, 0xb5, 0xd1, 0x74, 0x4c, 0x74, 0xb5, 0x81, 0x2f, 0x9a, 0x68, 0x5a, 0x23, 0x0f, 0x96, 0x52,
+		0x04, 0xd8, 0x57, 0x42, 0x54, 0x6c, 0x25, 0x25, 0xee, 0x79, 0x1d
+	};
+
+	// the same key PEM encoded, mbedtls_pk_parse_public_key needs the terminating null byte in the length
+	const char P256_PUBLIC_KEY_PEM[] =
+		"-----BEGIN PUBLIC KEY-----\n"
+		"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEvBdAH4PoarSGzuwBnwVWXvLWJgbF\n"
+		"J3mN4DJn3ICBh9Diutn0IkW10XRMdLWBL5poWiMPllIE2FdCVGwlJe55HQ==\n"
+		"-----END PUBLIC KEY-----\n";
+
+	// DER encoded ECDSA signature of the message
+	const unsigned char P256_SIGNATURE[] =
+	{
+		0x30, 0x46, 0x02, 0x21, 0x00, 0xa0, 0x1f, 0xf2, 0xdc, 0x1a, 0x45, 0x77, 0xa5, 0x41, 0x9f, 0xe6,
+		0xf3, 0x7a, 0x36, 0xbf, 0xdd, 0x60, 0xfa, 0xd0, 0x3a, 0x94, 0x08, 0xc6, 0x18, 0x57, 0x39, 0x18,
+		0xd5, 0xdc, 0xe7, 0x52, 0x7c, 0x02, 0x21, 0x00, 0xe1, 0x16, 0xa2, 0xca, 0x95, 0x57, 0x4f, 0xd2,
+		0xff, 0xc6, 0xb4, 0x2d, 0x58, 0xf1, 0x92, 0x2d, 0x54, 0xe3, 0x1c, 0x4a, 0x90, 0x5e, 0xf9, 0xc9,
+		0xd2, 0x72, 0x11, 0x0a, 0xbd, 0x4e, 0x2e, 0xed
+	};
+
+	// DER encoded RSA-2048 public key
+	const unsigned char RSA2048_PUBLIC_KEY[] =
+	{
+		0x30, 0x82, 0x01, 0x22, 0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01,
+		0x01, 0x05, 0x00, 0x03, 0x82, 0x01, 0x0f, 0x00, 0x30, 0x82, 0x01, 0x0a, 0x02, 0x82, 0x01, 0x01,
+		0x00, 0xa3, 0x08, 0xb3, 0x68, 0x28, 0x00, 0x60, 0xec, 0xf6, 0x53, 0x95, 0x17, 0x04, 0xd8, 0x75,
+		0xbb, 0xd3, 0xad, 0x22, 0xfc, 0x4e, 0xa9, 0x10, 0x6a, 0x70, 0x0c, 0x09, 0x1b, 0x1e, 0xfc, 0xf2,
+		0xcc, 0x38, 0xb8, 0xae, 0x06, 0xdb, 0x4b, 0xdc, 0x9d, 0x35, 0x0a, 0xd0, 0x77, 0x30, 0x6b, 0x99,
+		0x25, 0x3b, 0xf4, 0x15, 0xa7, 0xb5, 0x68, 0x88, 0xd3, 0xe0, 0xaf, 0xdb, 0x39, 0x98, 0x05, 0xa8,
+		0x1c, 0x2d, 0x4a, 0x04, 0xa6, 0x7b, 0x1c, 0x49, 0x4e, 0x34, 0x34, 0x3d, 0xcc, 0x76, 0xc8, 0xf0,
+		0xb6, 0xb4, 0xd5, 0x54, 0xcb, 0x05, 0xc0, 0xc9, 0x09, 0x50, 0x11, 0xb7, 0xd4, 0x7a, 0xe2, 0x7a,
+		0x11, 0xdb, 0x40, 0xab, 0x37, 0xb0, 0x6a, 0x0a, 0xb9, 0x57, 0x54, 0xa7, 0xa8, 0xf7, 0x53, 0x2d,
+		0x70, 0x68, 0x62, 0x4a, 0xe6, 0x1d, 0x59, 0x60, 0xa9, 0x55, 0x33, 0x71, 0x17, 0x45, 0xbf, 0xcb,
+		0x02, 0x50, 0xc6, 0x0b, 0xa1, 0x9c, 0xf6, 0x74, 0xbf, 0x76, 0x76, 0xa6, 0xc0, 0x23, 0x05, 0xb3,
+		0x67, 0xa8, 0xa2, 0xf6, 0x48, 0xee, 0x1f, 0x62, 0xb1, 0x05, 0xa9, 0x90, 0xa1, 0x2a, 0xb2, 0x8b,
+		0x10, 0xfe, 0x0b, 0xb3, 0x33, 0x77, 0x55, 0x62, 0x1e, 0x03, 0xe2, 0x89, 0x74, 0x43, 0xcf, 0x01,
+		0x9f, 0x74, 0xcd, 0x6d, 0x57, 0x49, 0xb9, 0x07, 0xe7, 0xe2, 0x76, 0x1c, 0x0d, 0xa8, 0xb0, 0x8a,
+		0x57, 0xda, 0xb4, 0x81, 0x17, 0xf0, 0x97, 0xe8, 0x83, 0x9e, 0x57, 0x03, 0x25, 0xa1, 0xf5, 0xec,
+		0x94, 0xb2, 0xe1, 0xf1, 0x68, 0x6a, 0xf9, 0x66, 0x61, 0x24, 0xb0, 0x1f, 0x76, 0x3e, 0x62, 0x3a,
+		0xe8, 0x1b, 0xe8, 0x52, 0x4f, 0x88, 0xeb, 0xb2, 0x58, 0x0b, 0xbd, 0x55, 0x2f, 0x31, 0x7a, 0x14,
+		0xd2, 0xd7, 0x44, 0x28, 0x43, 0xa8, 0x33, 0x69, 0xc3, 0x9a, 0x51, 0xb3, 0x12, 0x81, 0x6d, 0x4a,
+		0x57, 0x02, 0x03, 0x01, 0x00, 0x01
+	};
+
+	// PKCS#1 v1.5 signature of the message
+	const unsigned char RSA2048_SIGNATURE[] =
+	{
+		0x45, 0x82, 0x40, 0x01, 0x2c, 0x29, 0x6f, 0x80, 0x17, 0x69, 0x17, 0xe6, 0xd2, 0x2a, 0x17, 0xc4,
+		0xa9, 0x2f, 0x24, 0x8e, 0x96, 0xaf, 0x91, 0xb0, 0xd8, 0xe1, 0xd5, 0x23, 0x8d, 0xea, 0xc9, 0x60,
+		0xc5, 0x62, 0x15, 0x65, 0x4b, 0x42, 0xbc, 0xd7, 0x13, 0x83, 0xd0, 0x22, 0x3f, 0xd3, 0xa9, 0x24,
+		0xa8, 0xc7, 0x16, 0xc5, 0x56, 0xda, 0x83, 0x18, 0x55, 0xe1, 0xeb, 0xd4, 0xaf, 0xcb, 0x6a, 0xba,
+		0x4a, 0x84, 0xf4, 0x37, 0xe1, 0xea, 0x4b, 0xc5, 0xc9, 0x43, 0x2c, 0xe4, 0x01, 0xca, 0xa0, 0x21,
+		0x97, 0x3e, 0x19, 0x04, 0x9d, 0xb0, 0x95, 0x85, 0xf7, 0x1d, 0xdf, 0xed, 0x99, 0xb5, 0x52, 0x91,
+		0xbc, 0x92, 0x6e, 0xf6, 0x18, 0x92, 0x8b, 0x7f, 0x32, 0x92, 0x9b, 0x31, 0xdf, 0xd1, 0xb7, 0xd0,
+		0xc2, 0xe3, 0x99, 0x59, 0xb6, 0x0c, 0x27, 0x5c, 0x06, 0x92, 0x1c, 0xb7, 0xa3, 0x82, 0x50, 0xac,
+		0x40, 0x6a, 0x4b, 0x22, 0x17, 0x10, 0x99, 0x88, 0xa2, 0x8b, 0xe3, 0x98, 0x44, 0xf2, 0xb8, 0x50,
+		0x61, 0x4d, 0x35, 0x1b, 0xcf, 0x97, 0x63, 0x20, 0x85, 0x23, 0xdd, 0x44, 0x6b, 0x9d, 0x65, 0xb6,
+		0x4d, 0x42, 0xee, 0x32, 0xea, 0xbd, 0xe5, 0xdc, 0x4c, 0x7f, 0x2f, 0xa6, 0xed, 0xa0, 0xcd, 0xbd,
+		0xe7, 0xf9, 0xb6, 0xbc, 0x84, 0x0f, 0x40, 0x06, 0xb8, 0xee, 0xf4, 0xf6, 0x91, 0x3a, 0x0d, 0x8c,
+		0x33, 0x31, 0x3d, 0xdc, 0xa3, 0x0f, 0x40, 0xa2, 0xf8, 0xf5, 0xd7, 0xde, 0x55, 0x31, 0x37, 0xba,
+		0x41, 0xe8, 0x21, 0x32, 0x01, 0x13, 0x0c, 0x35, 0x1a, 0x95, 0x4a, 0xdc, 0xae, 0x04, 0xe8, 0xf0,
+		0x28, 0x62, 0xbc, 0xfc, 0x8f, 0x3a, 0xff, 0x37, 0x5b, 0x88, 0xb5, 0xbc, 0x4c, 0x43, 0x39, 0x2a,
+		0xd4, 0x14, 0x8e, 0x58, 0xd2, 0x89, 0xa4, 0x86, 0x9f, 0x93, 0x10, 0x24, 0x1e, 0xe2, 0x61, 0x6a
+	};
+}
+
+#endif // SIGNATURETESTVECTORS_H
@@ -0,0 +1,96 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestSupport.h"
+#include "SignatureTestVectors.h"
+
+#include "ECDSASignatureVerifier.h"
+
+#include <vector>
+
+/*
+ * Checks ECDSASignatureVerifier with mbedTLS against signatures made by the openssl command line tool.
+ */
+
+using namespace HostTest;
+using IDFix::FOTA::ECDSASignatureVerifier;
+
+namespace
+{
+	std::vector<unsigned char> bytes(const unsigned char* data, size_t length)
+	{
+		return std::vector<unsigned char>(data, data + length);
+	}
+
+	/* a signature made by openssl verifies, with the key DER or PEM encoded */
+	void testOpenSSLSignature()
+	{
+		ECDSASignatureVerifier derVerifier;
+		CHECK(derVerifier.setPublicKey(P256_PUBLIC_KEY, sizeof(P256_PUBLIC_KEY)), "DER key rejected");
+		CHECK(derVerifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), P256_SIGNATURE, sizeof(P256_SIGNATURE)) == 0, "signature does not verify");
+
+		ECDSASignatureVerifier pemVerifier;
+		CHECK(pemVerifier.setPublicKey(reinterpret_cast<const unsigned char*>(P256_PUBLIC_KEY_PEM), sizeof(P256_PUBLIC_KEY_PEM)), "PEM key rejected");
+		CHECK(pemVerifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), P256_SIGNATURE, sizeof(P256_SIGNATURE)) == 0, "signature does not verify");
+	}
+
+	/* any changed bit of the hash or the signature fails */
+	void testTamperedSignature()
+	{
+		ECDSASignatureVerifier verifier;
+		CHECK(verifier.setPublicKey(P256_PUBLIC_KEY, sizeof(P256_PUBLIC_KEY)), "key rejected");
+
+		std::vector<unsigned char> hash = bytes(MESSAGE_SHA256, sizeof(MESSAGE_SHA256));
+		hash[hash.size() / 2] ^= 0x01;
+		CHECK(verifier.verify(hash.data(), hash.size(), P256_SIGNATURE, sizeof(P256_SIGNATURE)) != 0, "changed hash verifies");
+
+		for ( size_t offset : { static_cast<size_t>(8), sizeof(P256_SIGNATURE) / 2, sizeof(P256_SIGNATURE) - 1 } )
+		{
+			std::vector<unsigned char> signature = bytes(P256_SIGNATURE, sizeof(P256_SIGNATURE));
+			signature[offset] ^= 0x10;
+			CHECK(verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), signature.data(), signature.size()) != 0,
+				  "signature changed at %u verifies", static_cast<unsigned>(offset));
+		}
+
+		CHECK(verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), P256_SIGNATURE, sizeof(P256_SIGNATURE) - 1) != 0, "truncated signature verifies");
+		CHECK(verifier.verify(MESSAGE_SHA256, 20, P256_SIGNATURE, sizeof(P256_SIGNATURE)) != 0, "SHA-1 sized hash accepted");
+	}
+
+	/* keys of other types are refused, without a key nothing verifies */
+	void testWrongKey()
+	{
+		ECDSASignatureVerifier verifier;
+		CHECK(verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), P256_SIGNATURE, sizeof(P256_SIGNATURE)) != 0, "verifies without a key");
+
+		CHECK(verifier.setPublicKey(RSA2048_PUBLIC_KEY, sizeof(RSA2048_PUBLIC_KEY)) == false, "RSA key accepted");
+		CHECK(verifier.verify(MESSAGE_SHA256, sizeof(MESSAGE_SHA256), RSA2048_SIGNATURE, sizeof(RSA2048_SIGNATURE)) != 0, "RSA signature verifies");
+
+		std::vector<unsigned char> key = bytes(P256_PUBLIC_KEY, sizeof(P256_PUBLIC_KEY));
+		key.resize(key.size() / 2);
+		CHECK(verifier.setPublicKey(key.data(), key.size()) == false, "truncated key accepted");
+	}
+}
+
+int main()
+{
+	testOpenSSLSignature();
+	testTamperedSignature();
+	testWrongKey();
+
+	printf("signature: all ok\n");
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FakeClock.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	std::atomic<int64_t>	virtualTime(0);
+	std::atomic<bool>		realTime(false);
+	std::atomic<int64_t>	realTimeOffset(0);
+
+	int64_t monotonicUs()
+	{
+		static const auto start = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+namespace HostTest
+{
+	int64_t FakeClock::now()
+	{
+		return realTime ? monotonicUs() + realTimeOffset : virtualTime.load();
+	}
+
+	void FakeClock::spend(int64_t us)
+	{
+		if ( us <= 0 )
+		{
+			return;
+		}
+
+		if ( realTime )
+		{
+			int64_t end = monotonicUs() + us;
+			while ( monotonicUs() < end )
+			{
+			}
+			return;
+		}
+
+		virtualTime += us;
+	}
+
+	void FakeClock::sleep(int64_t us)
+	{
+		if ( realTime )
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(us > 0 ? us : 0));
+			return;
+		}
+
+		spend(us);
+	}
+
+	void FakeClock::advance(int64_t us)
+	{
+		if ( us <= 0 )
+		{
+			return;
+		}
+
+		if ( realTime )
+		{
+			realTimeOffset += us;
+			return;
+		}
+
+		virtualTime += us;
+	}
+
+	void FakeClock::setRealTime(bool enabled)
+	{
+		realTime = enabled;
+	}
+
+	bool FakeClock::isRealTime()
+	{
+		return realTime;
+	}
+}
@@ -0,0 +1,58 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKECLOCK_H
+#define FAKECLOCK_H
+
+#include <stdint.h>
+
+namespace HostTest
+{
+    /**
+     * @brief The FakeClock class drives esp_timer_get_time and vTaskDelay of the host build.
+     *
+     * In virtual mode (default) time only passes when a fake spends it, so stalls and throttling of
+     * many seconds run instantly and deterministically. Real mode uses the monotonic clock and real
+     * sleeps, for tests with several threads.
+     */
+	class FakeClock
+	{
+		public:
+
+			static int64_t		now();
+
+            /**
+             * @brief           Let time pass, busy waits in real mode
+             */
+			static void			spend(int64_t us);
+
+            /**
+             * @brief           Block the calling task, sleeps in real mode
+             */
+			static void			sleep(int64_t us);
+
+            /**
+             * @brief           Move the clock forward at once, in real mode as well
+             */
+			static void			advance(int64_t us);
+
+			static void			setRealTime(bool realTime);
+			static bool			isRealTime();
+	};
+}
+
+#endif // FAKECLOCK_H
@@ -0,0 +1,171 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FakeFirmwareSource.h"
+#include "FakeClock.h"
+
+#include <cstring>
+
+namespace HostTest
+{
+	FakeFirmwareSource::FakeFirmwareSource(const std::vector<uint8_t>& image, uint32_t seed) :
+		_image(image),
+		_random(seed != 0 ? seed : 1)
+	{
+
+	}
+
+	void FakeFirmwareSource::setFaults(const Faults& faults)
+	{
+		_faults = faults;
+	}
+
+	void FakeFirmwareSource::setTiming(const Timing& timing)
+	{
+		_timing = timing;
+	}
+
+	const FakeFirmwareSource::Stats& FakeFirmwareSource::stats() const
+	{
+		return _stats;
+	}
+
+	bool FakeFirmwareSource::open(size_t offset)
+	{
+		_stats.opens++;
+
+		if ( _faults.failOpen || offset > _image.size() )
+		{
+			return false;
+		}
+
+		_startOffset = offset;
+		_position = offset;
+		_stallEnd = -1;
+		_open = true;
+		return true;
+	}
+
+	void FakeFirmwareSource::close()
+	{
+		_stats.closes++;
+		_open = false;
+	}
+
+	bool FakeFirmwareSource::isOpen() const
+	{
+		return _open;
+	}
+
+	int FakeFirmwareSource::contentLength() const
+	{
+		return _faults.unknownLength ? 0 : static_cast<int>(_image.size() - _startOffset);
+	}
+
+	int FakeFirmwareSource::read(void* buffer, size_t size)
+	{
+		if ( ! _open )
+		{
+			return -1;
+		}
+
+		_stats.reads++;
+
+		if ( _position >= _faults.errorAt )
+		{
+			return -1;
+		}
+
+		size = available(size);
+
+		if ( size == 0 )
+		{
+			_stats.emptyReads++;
+			FakeClock::spend(_timing.emptyReadUs);
+			return 0;
+		}
+
+		memcpy(buffer, &_image[_position], size);
+
+		if ( _faults.corruptAt >= _position && _faults.corruptAt < _position + size )
+		{
+			static_cast<uint8_t*>(buffer)[_faults.corruptAt - _position] ^= 0x04;
+		}
+
+		_position += size;
+		_stats.deliveredBytes += size;
+		FakeClock::spend(_timing.perReadUs + _timing.usPerKiB * static_cast<int64_t>(size) / 1024);
+
+		return static_cast<int>(size);
+	}
+
+	bool FakeFirmwareSource::isComplete()
+	{
+		return _position >= _image.size() || _position >= _faults.truncateAt;
+	}
+
+	size_t FakeFirmwareSource::available(size_t size)
+	{
+		if ( isComplete() )
+		{
+			return 0;
+		}
+
+		if ( _position >= _faults.stallAt && _stallEnd < 0 )
+		{
+			_stallEnd = FakeClock::now() + _faults.stallUs;
+		}
+
+		if ( _stallEnd >= 0 && FakeClock::now() < _stallEnd )
+		{
+			return 0;
+		}
+
+		size_t end = _image.size() < _faults.truncateAt ? _image.size() : _faults.truncateAt;
+
+		if ( _faults.errorAt < end )
+		{
+			end = _faults.errorAt;
+		}
+
+		if ( _faults.stallAt > _position && _faults.stallAt < end )
+		{
+			end = _faults.stallAt;
+		}
+
+		if ( size > end - _position )
+		{
+			size = end - _position;
+		}
+
+		if ( _faults.shortReads && size > 1 )
+		{
+			size = 1 + random() % size;
+		}
+
+		return size;
+	}
+
+	uint32_t FakeFirmwareSource::random()
+	{
+		// xorshift32, reproducible for a given seed
+		_random ^= _random << 13;
+		_random ^= _random >> 17;
+		_random ^= _random << 5;
+		return _random;
+	}
+}
@@ -0,0 +1,99 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKEFIRMWARESOURCE_H
+#define FAKEFIRMWARESOURCE_H
+
+#include "IFirmwareSource.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace HostTest
+{
+    /**
+     * @brief The FakeFirmwareSource class delivers an image from memory and injects stream faults.
+     *
+     * Time passes on the FakeClock as the source is read, so throttling, stalls and the stall timeout
+     * of the transfer behave as on a slow network.
+     */
+	class FakeFirmwareSource : public IDFix::FOTA::IFirmwareSource
+	{
+		public:
+
+			static const size_t NEVER = SIZE_MAX;
+
+			struct Faults
+			{
+				bool		shortReads = { false };			///< return a random part of the requested size
+				bool		unknownLength = { false };		///< contentLength() reports 0
+				size_t		stallAt = { NEVER };			///< no data for stallUs once this image offset is reached
+				int64_t		stallUs = { 0 };
+				size_t		truncateAt = { NEVER };			///< the stream ends early at this offset
+				size_t		errorAt = { NEVER };			///< read() fails at this offset
+				size_t		corruptAt = { NEVER };			///< flip a bit of the byte at this offset
+				bool		failOpen = { false };
+			};
+
+			struct Timing
+			{
+				int64_t		usPerKiB = { 1000 };			///< transfer time of the data
+				int64_t		perReadUs = { 0 };				///< fixed cost of every read that delivers data
+				int64_t		emptyReadUs = { 1000 };			///< time a read without data blocks, 0 = returns at once
+			};
+
+			struct Stats
+			{
+				uint32_t	opens = { 0 };
+				uint32_t	closes = { 0 };
+				uint32_t	reads = { 0 };
+				uint32_t	emptyReads = { 0 };
+				size_t		deliveredBytes = { 0 };
+			};
+
+			explicit				FakeFirmwareSource(const std::vector<uint8_t>& image, uint32_t seed = 1);
+
+			void					setFaults(const Faults& faults);
+			void					setTiming(const Timing& timing);
+
+			const Stats&			stats() const;
+			bool					isOpen() const;
+
+			bool					open(size_t offset) override;
+			void					close() override;
+			int						contentLength() const override;
+			int						read(void* buffer, size_t size) override;
+			bool					isComplete() override;
+
+		private:
+
+			size_t					available(size_t size);
+			uint32_t				random();
+
+			const std::vector<uint8_t>&	_image;
+			Faults					_faults;
+			Timing					_timing;
+			Stats					_stats;
+			uint32_t				_random;
+			size_t					_startOffset = { 0 };
+			size_t					_position = { 0 };
+			int64_t					_stallEnd = { -1 };
+			bool					_open = { false };
+	};
+}
+
+#endif // FAKEFIRMWARESOURCE_H
@@ -0,0 +1,502 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FakeFlash.h"
+#include "FakeClock.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+
+namespace
+{
+	const uint32_t		SECTOR_SIZE			= SPI_FLASH_SEC_SIZE;
+	const uint32_t		BLOCK_SIZE			= 65536;
+	const uint32_t		PARTITION_COUNT		= 3;
+	const uint32_t		CHIP_SIZE			= 0x390000;
+	const uint8_t		IMAGE_MAGIC			= 0xE9;
+
+	const esp_partition_t partitions[PARTITION_COUNT] =
+	{
+		{ nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x010000, 0x100000, "ota_0", false },
+		{ nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x110000, 0x100000, "ota_1", false },
+		{ nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_UNDEFINED, 0x210000, 0x180000, "fota_cache", false }
+	};
+
+	struct OTAEntry
+	{
+		const esp_partition_t*	partition;
+		bool					needErase;
+		uint32_t				wroteSize;
+		bool					wroteAny;
+	};
+
+	std::vector<uint8_t>				chip(CHIP_SIZE, 0xFF);
+	std::map<esp_ota_handle_t, OTAEntry> otaEntries;
+	esp_ota_handle_t					lastHandle = 0;
+	const esp_partition_t*				runningPartition = &partitions[0];
+	const esp_partition_t*				bootingPartition = &partitions[0];
+
+	uint32_t							failAddress = UINT32_MAX;
+	uint32_t							powerCutCountdown = 0;
+	HostTest::FakeFlash::Timing			timing;
+	HostTest::FakeFlash::Stats			stats;
+	std::mutex							bus;
+
+	bool validPartition(const esp_partition_t* partition)
+	{
+		return partition >= &partitions[0] && partition < &partitions[PARTITION_COUNT];
+	}
+
+	bool inRange(const esp_partition_t* partition, size_t offset, size_t size)
+	{
+		return validPartition(partition) && offset <= partition->size && size <= partition->size - offset;
+	}
+
+	/* counts a flash operation, returns true if the power is cut during it */
+	bool powerFails()
+	{
+		stats.operations++;
+
+		if ( powerCutCountdown > 0 && --powerCutCountdown == 0 )
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	/* the flash is busy for the given time, other tasks needing it have to wait */
+	void busy(int64_t us)
+	{
+		{
+			std::lock_guard<std::mutex> lock(bus);
+			HostTest::FakeClock::spend(us);
+		}
+
+		if ( us > stats.longestOperationUs )
+		{
+			stats.longestOperationUs = us;
+		}
+
+		if ( HostTest::FakeClock::isRealTime() )
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	esp_err_t writeFlash(const esp_partition_t* partition, size_t offset, const void* data, size_t size)
+	{
+		if ( ! inRange(partition, offset, size) )
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		uint32_t address = partition->address + offset;
+
+		if ( failAddress >= address && failAddress < address + size )
+		{
+			return ESP_FAIL;
+		}
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		size_t applied = size;
+		bool cut = powerFails();
+
+		if ( cut )
+		{
+			// only a part of the data reaches the flash
+			applied = size > 1 ? stats.operations % size : 0;
+		}
+
+		for ( size_t i = 0; i < applied; i++ )
+		{
+			// NOR flash can only clear bits
+			chip[address + i] &= bytes[i];
+		}
+
+		if ( cut )
+		{
+			throw HostTest::PowerCut();
+		}
+
+		stats.writtenBytes += size;
+		busy(timing.writeUsPerKiB * static_cast<int64_t>(size) / 1024);
+
+		return ESP_OK;
+	}
+
+	esp_err_t eraseFlash(const esp_partition_t* partition, size_t offset, size_t size)
+	{
+		if ( ! inRange(partition, offset, size) )
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		if ( offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0 )
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		uint32_t address = partition->address + offset;
+		uint32_t end = address + size;
+
+		while ( address < end )
+		{
+			// like spi_flash_erase_range, aligned 64 KiB blocks are erased at once
+			bool block = timing.blockEraseUs > 0 && address % BLOCK_SIZE == 0 && end - address >= BLOCK_SIZE;
+			uint32_t length = block ? BLOCK_SIZE : SECTOR_SIZE;
+
+			if ( powerFails() )
+			{
+				// an interrupted erase leaves the sector half erased
+				memset(&chip[address], 0xFF, SECTOR_SIZE / 2);
+				throw HostTest::PowerCut();
+			}
+
+			memset(&chip[address], 0xFF, length);
+			stats.erasedSectors += length / SECTOR_SIZE;
+			busy(block ? timing.blockEraseUs : timing.sectorEraseUs * (length / SECTOR_SIZE));
+
+			address += length;
+		}
+
+		return ESP_OK;
+	}
+
+	bool imageValid(const esp_partition_t* partition)
+	{
+		return chip[partition->address] == IMAGE_MAGIC;
+	}
+
+	OTAEntry* findEntry(esp_ota_handle_t handle)
+	{
+		auto entry = otaEntries.find(handle);
+		return entry != otaEntries.end() ? &entry->second : nullptr;
+	}
+}
+
+namespace HostTest
+{
+	void FakeFlash::reset()
+	{
+		std::fill(chip.begin(), chip.end(), 0xFF);
+		runningPartition = &partitions[0];
+		bootingPartition = &partitions[0];
+		otaEntries.clear();
+		clearFaults();
+		resetStats();
+	}
+
+	void FakeFlash::reboot()
+	{
+		otaEntries.clear();
+		clearFaults();
+		runningPartition = bootingPartition;
+	}
+
+	const esp_partition_t* FakeFlash::otaPartition(int index)
+	{
+		return &partitions[index];
+	}
+
+	const esp_partition_t* FakeFlash::dataPartition()
+	{
+		return &partitions[2];
+	}
+
+	const esp_partition_t* FakeFlash::bootPartition()
+	{
+		return bootingPartition;
+	}
+
+	std::vector<uint8_t> FakeFlash::read(const esp_partition_t* partition, size_t offset, size_t size)
+	{
+		const uint8_t* start = &chip[partition->address + offset];
+		return std::vector<uint8_t>(start, start + size);
+	}
+
+	void FakeFlash::corrupt(const esp_partition_t* partition, size_t offset)
+	{
+		chip[partition->address + offset] ^= 0x10;
+	}
+
+	void FakeFlash::failWritesAt(const esp_partition_t* partition, size_t offset)
+	{
+		failAddress = partition->address + offset;
+	}
+
+	void FakeFlash::powerCutAtOperation(uint32_t operation)
+	{
+		powerCutCountdown = operation;
+	}
+
+	void FakeFlash::clearFaults()
+	{
+		failAddress = UINT32_MAX;
+		powerCutCountdown = 0;
+	}
+
+	void FakeFlash::setTiming(const Timing& newTiming)
+	{
+		timing = newTiming;
+	}
+
+	std::mutex& FakeFlash::busLock()
+	{
+		return bus;
+	}
+
+	const FakeFlash::Stats& FakeFlash::stats()
+	{
+		return ::stats;
+	}
+
+	void FakeFlash::resetStats()
+	{
+		::stats = Stats();
+	}
+}
+
+extern "C"
+{
+	esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+	{
+		if ( ! inRange(partition, src_offset, size) )
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		memcpy(dst, &chip[partition->address + src_offset], size);
+		return ESP_OK;
+	}
+
+	esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size)
+	{
+		return writeFlash(partition, dst_offset, src, size);
+	}
+
+	esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size)
+	{
+		return eraseFlash(partition, offset, size);
+	}
+
+	const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+	{
+		for ( const esp_partition_t& partition : partitions )
+		{
+			if ( partition.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype)
+				 && (label == nullptr || strcmp(partition.label, label) == 0) )
+			{
+				return &partition;
+			}
+		}
+
+		return nullptr;
+	}
+
+	esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle)
+	{
+		if ( ! validPartition(partition) || partition->type != ESP_PARTITION_TYPE_APP || out_handle == nullptr )
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		if ( partition == runningPartition )
+		{
+			return ESP_ERR_OTA_PARTITION_CONFLICT;
+		}
+
+		if ( image_size != OTA_WITH_SEQUENTIAL_WRITES )
+		{
+			size_t eraseSize = partition->size;
+
+			if ( image_size != 0 && image_size != OTA_SIZE_UNKNOWN )
+			{
+				if ( image_size > partition->size )
+				{
+					return ESP_ERR_INVALID_SIZE;
+				}
+
+				eraseSize = (image_size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+			}
+
+			esp_err_t result = eraseFlash(partition, 0, eraseSize);
+
+			if ( result != ESP_OK )
+			{
+				return result;
+			}
+		}
+
+		*out_handle = ++lastHandle;
+		otaEntries[*out_handle] = { partition, image_size == OTA_WITH_SEQUENTIAL_WRITES, 0, false };
+
+		return ESP_OK;
+	}
+
+	esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+	{
+		OTAEntry* entry = findEntry(handle);
+
+		if ( entry == nullptr )
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		if ( entry->wroteSize == 0 && size > 0 && static_cast<const uint8_t*>(data)[0] != IMAGE_MAGIC )
+		{
+			return ESP_ERR_OTA_VALIDATE_FAILED;
+		}
+
+		if ( entry->needErase && size > 0 )
+		{
+			// same as IDF: erase the sectors the write reaches for the first time
+			uint32_t firstSector = entry->wroteSize / SECTOR_SIZE;
+			uint32_t lastSector = (entry->wroteSize + size - 1) / SECTOR_SIZE;
+			esp_err_t result = ESP_OK;
+
+			if ( entry->wroteSize % SECTOR_SIZE == 0 )
+			{
+				result = eraseFlash(entry->partition, entry->wroteSize, (lastSector - firstSector + 1) * SECTOR_SIZE);
+			}
+			else if ( firstSector != lastSector )
+			{
+				result = eraseFlash(entry->partition, (firstSector + 1) * SECTOR_SIZE, (lastSector - firstSector) * SECTOR_SIZE);
+			}
+
+			if ( result != ESP_OK )
+			{
+				return result;
+			}
+		}
+
+		esp_err_t result = writeFlash(entry->partition, entry->wroteSize, data, size);
+
+		if ( result == ESP_OK )
+		{
+			entry->wroteSize += size;
+			entry->wroteAny = true;
+		}
+
+		return result;
+	}
+
+	esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void* data, size_t size, uint32_t offset)
+	{
+		OTAEntry* entry = findEntry(handle);
+
+		if ( entry == nullptr )
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		if ( entry->needErase )
+		{
+			// IDF asserts here, nothing erases the target range
+			fprintf(stderr, "esp_ota_write_with_offset: must erase the partition before writing to it\n");
+			abort();
+		}
+
+		esp_err_t result = writeFlash(entry->partition, offset, data, size);
+
+		if ( result == ESP_OK )
+		{
+			entry->wroteAny = true;
+		}
+
+		return result;
+	}
+
+	esp_err_t esp_ota_end(esp_ota_handle_t handle)
+	{
+		OTAEntry* entry = findEntry(handle);
+
+		if ( entry == nullptr )
+		{
+			return ESP_ERR_NOT_FOUND;
+		}
+
+		esp_err_t result = ESP_OK;
+
+		if ( entry->wroteAny == false )
+		{
+			result = ESP_ERR_INVALID_ARG;
+		}
+		else if ( ! imageValid(entry->partition) )
+		{
+			result = ESP_ERR_OTA_VALIDATE_FAILED;
+		}
+
+		otaEntries.erase(handle);
+		return result;
+	}
+
+	esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+	{
+		return otaEntries.erase(handle) > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+	}
+
+	esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+	{
+		if ( ! validPartition(partition) || partition->type != ESP_PARTITION_TYPE_APP )
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		if ( ! imageValid(partition) )
+		{
+			return ESP_ERR_OTA_VALIDATE_FAILED;
+		}
+
+		// otadata is written with two copies, a power cut keeps the old boot partition
+		if ( powerFails() )
+		{
+			throw HostTest::PowerCut();
+		}
+
+		if ( partition != bootingPartition )
+		{
+			stats.bootSwitches++;
+		}
+
+		bootingPartition = partition;
+		return ESP_OK;
+	}
+
+	const esp_partition_t* esp_ota_get_boot_partition(void)
+	{
+		return bootingPartition;
+	}
+
+	const esp_partition_t* esp_ota_get_running_partition(void)
+	{
+		return runningPartition;
+	}
+
+	const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from)
+	{
+		if ( start_from == nullptr )
+		{
+			start_from = runningPartition;
+		}
+
+		return start_from == &partitions[0] ? &partitions[1] : &partitions[0];
+	}
+}
@@ -0,0 +1,113 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKEFLASH_H
+#define FAKEFLASH_H
+
+extern "C"
+{
+	#include "esp_ota_ops.h"
+}
+
+#include <mutex>
+#include <vector>
+
+namespace HostTest
+{
+    /**
+     * @brief The PowerCut struct is thrown by a flash operation when an injected power cut triggers.
+     *
+     * The operation is applied partially, everything in RAM is lost - the test has to simulate a reboot.
+     */
+	struct PowerCut {};
+
+    /**
+     * @brief The FakeFlash class emulates the flash chip behind esp_partition_* and esp_ota_*.
+     *
+     * Writes can only clear bits like NOR flash, erases set whole sectors to 0xFF. The partition table
+     * holds two 1 MiB OTA app partitions and a 1.5 MiB data partition labeled "fota_cache".
+     */
+	class FakeFlash
+	{
+		public:
+
+			struct Timing
+			{
+				int64_t		sectorEraseUs = { 0 };
+				int64_t		blockEraseUs = { 0 };		///< 64 KiB blocks, used for aligned parts of large erases
+				int64_t		writeUsPerKiB = { 0 };
+			};
+
+			struct Stats
+			{
+				uint32_t	bootSwitches = { 0 };
+				uint32_t	operations = { 0 };			///< writes and sector erases
+				uint32_t	erasedSectors = { 0 };
+				uint64_t	writtenBytes = { 0 };
+				int64_t		longestOperationUs = { 0 };	///< longest time the flash was busy in one call
+			};
+
+            /**
+             * @brief           Erase the whole chip, boot and run from ota_0, drop faults and statistics
+             */
+			static void						reset();
+
+            /**
+             * @brief           Drop everything a reboot loses (open OTA handles, pending faults) and run the boot partition
+             */
+			static void						reboot();
+
+			static const esp_partition_t*	otaPartition(int index);
+			static const esp_partition_t*	dataPartition();
+			static std::vector<uint8_t>		read(const esp_partition_t* partition, size_t offset, size_t size);
+
+            /**
+             * @brief           Corrupt flash content behind the back of the component, e.g. to fake bit rot
+             */
+			static void						corrupt(const esp_partition_t* partition, size_t offset);
+
+            /**
+             * @brief           Let every write to partition that covers offset fail
+             */
+			static void						failWritesAt(const esp_partition_t* partition, size_t offset);
+
+            /**
+             * @brief           Cut the power during the given flash operation, counted from now (1 = the next one)
+             */
+			static void						powerCutAtOperation(uint32_t operation);
+			static void						clearFaults();
+
+			static void						setTiming(const Timing& timing);
+
+            /**
+             * @brief           Partition that boots after the next reboot()
+             */
+			static const esp_partition_t*	bootPartition();
+
+            /**
+             * @brief           Held while the flash is busy - on the device the cache is disabled for that time
+             *
+             * A competing task that locks it models a task that needs the cache.
+             */
+			static std::mutex&				busLock();
+
+			static const Stats&				stats();
+			static void						resetStats();
+	};
+}
+
+#endif // FAKEFLASH_H
@@ -0,0 +1,178 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FakeHTTPClient.h"
+#include "FakeClock.h"
+
+#include "esp_http_client.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// the IDF default when buffer_size is 0
+	const int	DEFAULT_BUFFER_SIZE		= 512;
+
+	std::vector<uint8_t>		servedImage;
+	int							servedStatusCode = 200;
+	bool						rangesSupported = true;
+	HostTest::FakeHTTPClient::Timing	timing;
+	HostTest::FakeHTTPClient::Stats		stats;
+}
+
+struct esp_http_client
+{
+	int				bufferSize;
+	size_t			rangeStart;
+	size_t			position;
+	bool			open;
+};
+
+namespace HostTest
+{
+	void FakeHTTPClient::serve(const std::vector<uint8_t>& image, int statusCode, bool supportsRanges)
+	{
+		servedImage = image;
+		servedStatusCode = statusCode;
+		rangesSupported = supportsRanges;
+	}
+
+	void FakeHTTPClient::setTiming(const Timing& newTiming)
+	{
+		timing = newTiming;
+	}
+
+	const FakeHTTPClient::Stats& FakeHTTPClient::stats()
+	{
+		return ::stats;
+	}
+
+	void FakeHTTPClient::reset()
+	{
+		servedImage.clear();
+		servedStatusCode = 200;
+		rangesSupported = true;
+		timing = Timing();
+		::stats = Stats();
+	}
+}
+
+extern "C"
+{
+	esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config)
+	{
+		stats.inits++;
+		stats.lastBufferSize = config->buffer_size;
+
+		esp_http_client_handle_t client = new esp_http_client();
+		client->bufferSize = config->buffer_size > 0 ? config->buffer_size : DEFAULT_BUFFER_SIZE;
+		client->rangeStart = 0;
+		client->position = 0;
+		client->open = false;
+		stats.lastRangeStart = -1;
+		return client;
+	}
+
+	esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value)
+	{
+		unsigned start = 0;
+
+		if ( strcmp(key, "Range") != 0 || sscanf(value, "bytes=%u-", &start) != 1 )
+		{
+			return ESP_OK;
+		}
+
+		stats.lastRangeStart = static_cast<int>(start);
+
+		if ( rangesSupported )
+		{
+			client->rangeStart = start;
+		}
+
+		return ESP_OK;
+	}
+
+	esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+	{
+		client->open = true;
+		client->position = client->rangeStart < servedImage.size() ? client->rangeStart : servedImage.size();
+		return ESP_OK;
+	}
+
+	int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+	{
+		return static_cast<int>(servedImage.size() - client->position);
+	}
+
+	int esp_http_client_get_status_code(esp_http_client_handle_t client)
+	{
+		return servedStatusCode == 200 && client->rangeStart > 0 ? 206 : servedStatusCode;
+	}
+
+	int esp_http_client_read(esp_http_client_handle_t client, char* buffer, int len)
+	{
+		if ( ! client->open )
+		{
+			return -1;
+		}
+
+		int read = 0;
+
+		while ( read < len && client->position < servedImage.size() )
+		{
+			size_t size = static_cast<size_t>(len - read);
+
+			if ( size > static_cast<size_t>(client->bufferSize) )
+			{
+				size = client->bufferSize;
+			}
+
+			if ( size > servedImage.size() - client->position )
+			{
+				size = servedImage.size() - client->position;
+			}
+
+			memcpy(buffer + read, &servedImage[client->position], size);
+			client->position += size;
+			read += static_cast<int>(size);
+
+			stats.transportReads++;
+			HostTest::FakeClock::spend(timing.perTransportReadUs + timing.usPerKiB * static_cast<int64_t>(size) / 1024);
+		}
+
+		return read;
+	}
+
+	bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+	{
+		return client->position >= servedImage.size();
+	}
+
+	esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+	{
+		client->open = false;
+		return ESP_OK;
+	}
+
+	esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+	{
+		stats.cleanups++;
+		delete client;
+		return ESP_OK;
+	}
+}
@@ -0,0 +1,59 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKEHTTPCLIENT_H
+#define FAKEHTTPCLIENT_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace HostTest
+{
+    /**
+     * @brief The FakeHTTPClient class implements esp_http_client_* for the host build, serving one image.
+     *
+     * Like the IDF client, esp_http_client_read() loops until the requested size is read and reads the
+     * transport in pieces of at most \c buffer_size bytes, each costing \c perTransportReadUs on the FakeClock.
+     * A Range header of the form "bytes=N-" is answered with 206 unless range requests are disabled.
+     */
+	class FakeHTTPClient
+	{
+		public:
+
+			struct Timing
+			{
+				int64_t		usPerKiB = { 100 };
+				int64_t		perTransportReadUs = { 500 };
+			};
+
+			struct Stats
+			{
+				uint32_t	inits = { 0 };
+				uint32_t	cleanups = { 0 };
+				uint32_t	transportReads = { 0 };
+				int			lastBufferSize = { 0 };			///< buffer_size of the last configuration passed to init
+				int			lastRangeStart = { -1 };		///< start of the last range request, -1 without one
+			};
+
+			static void				serve(const std::vector<uint8_t>& image, int statusCode = 200, bool supportsRanges = true);
+			static void				setTiming(const Timing& timing);
+			static const Stats&		stats();
+			static void				reset();
+	};
+}
+
+#endif // FAKEHTTPCLIENT_H
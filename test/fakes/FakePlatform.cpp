@@ -0,0 +1,318 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FakePlatform.h"
+#include "FakeClock.h"
+
+extern "C"
+{
+	#include "esp_err.h"
+	#include "esp_log.h"
+	#include "esp_timer.h"
+	#include "esp_heap_caps.h"
+	#include "esp_rom_crc.h"
+	#include "nvs.h"
+	#include "freertos/task.h"
+}
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	std::mutex										nvsMutex;
+	std::map<std::string, std::vector<uint8_t>>		nvsBlobs;
+	std::map<nvs_handle_t, std::string>				nvsNamespaces;
+	nvs_handle_t									nvsNextHandle = 1;
+	std::atomic<uint32_t>							nvsWrites(0);
+	std::atomic<uint32_t>							nvsReadWriteOpens(0);
+
+	std::atomic<size_t>								freeHeap(256 * 1024);
+
+	std::atomic<uint32_t>							taskStackSize(0);
+	std::atomic<uint32_t>							taskCount(0);
+	std::mutex										heldTasksMutex;
+	bool											tasksHeld = false;
+	std::vector<std::pair<TaskFunction_t, void*>>	heldTasks;
+
+	int logLevel()
+	{
+		static const int level = getenv("IDFIX_TEST_LOG_LEVEL") ? atoi(getenv("IDFIX_TEST_LOG_LEVEL")) : 0;
+		return level;
+	}
+
+	std::string nvsKey(nvs_handle_t handle, const char* key)
+	{
+		return nvsNamespaces[handle] + "/" + key;
+	}
+}
+
+namespace HostTest
+{
+	void FakeNVS::clear()
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+		nvsBlobs.clear();
+		nvsWrites = 0;
+		nvsReadWriteOpens = 0;
+	}
+
+	uint32_t FakeNVS::writeCount()
+	{
+		return nvsWrites;
+	}
+
+	uint32_t FakeNVS::readWriteOpenCount()
+	{
+		return nvsReadWriteOpens;
+	}
+
+	void FakeHeap::setFreeSize(size_t size)
+	{
+		freeHeap = size;
+	}
+
+	uint32_t FakeTasks::lastStackSize()
+	{
+		return taskStackSize;
+	}
+
+	uint32_t FakeTasks::createdTasks()
+	{
+		return taskCount;
+	}
+
+	void FakeTasks::holdTasks()
+	{
+		std::lock_guard<std::mutex> lock(heldTasksMutex);
+		tasksHeld = true;
+	}
+
+	void FakeTasks::startHeldTasks()
+	{
+		std::lock_guard<std::mutex> lock(heldTasksMutex);
+		tasksHeld = false;
+
+		for ( const auto& task : heldTasks )
+		{
+			std::thread(task.first, task.second).detach();
+		}
+
+		heldTasks.clear();
+	}
+}
+
+extern "C"
+{
+	const char* esp_err_to_name(esp_err_t code)
+	{
+		switch ( code )
+		{
+			case ESP_OK:						return "ESP_OK";
+			case ESP_FAIL:						return "ESP_FAIL";
+			case ESP_ERR_NO_MEM:				return "ESP_ERR_NO_MEM";
+			case ESP_ERR_INVALID_ARG:			return "ESP_ERR_INVALID_ARG";
+			case ESP_ERR_INVALID_STATE:			return "ESP_ERR_INVALID_STATE";
+			case ESP_ERR_INVALID_SIZE:			return "ESP_ERR_INVALID_SIZE";
+			case ESP_ERR_NOT_FOUND:				return "ESP_ERR_NOT_FOUND";
+			case ESP_ERR_NOT_SUPPORTED:			return "ESP_ERR_NOT_SUPPORTED";
+			case ESP_ERR_OTA_VALIDATE_FAILED:	return "ESP_ERR_OTA_VALIDATE_FAILED";
+			default:							return "UNKNOWN ERROR";
+		}
+	}
+
+	void host_log_write(int level, const char* tag, const char* format, ...)
+	{
+		if ( level > logLevel() )
+		{
+			return;
+		}
+
+		va_list arguments;
+		va_start(arguments, format);
+		fprintf(stderr, "%c (%s) ", "?EWID"[level], tag);
+		vfprintf(stderr, format, arguments);
+		fputc('\n', stderr);
+		va_end(arguments);
+	}
+
+	int64_t esp_timer_get_time(void)
+	{
+		return HostTest::FakeClock::now();
+	}
+
+	size_t heap_caps_get_free_size(uint32_t caps)
+	{
+		(void)caps;
+		return freeHeap;
+	}
+
+	size_t heap_caps_get_largest_free_block(uint32_t caps)
+	{
+		(void)caps;
+		return freeHeap;
+	}
+
+	void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+	{
+		(void)caps;
+		return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+	}
+
+	void heap_caps_free(void* ptr)
+	{
+		free(ptr);
+	}
+
+	uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+	{
+		static uint32_t table[256];
+		static bool tableReady = false;
+
+		if ( ! tableReady )
+		{
+			for ( uint32_t i = 0; i < 256; i++ )
+			{
+				uint32_t value = i;
+				for ( int bit = 0; bit < 8; bit++ )
+				{
+					value = (value >> 1) ^ (0xEDB88320 & (0 - (value & 1)));
+				}
+				table[i] = value;
+			}
+			tableReady = true;
+		}
+
+		crc = ~crc;
+		for ( uint32_t i = 0; i < len; i++ )
+		{
+			crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+
+		if ( open_mode == NVS_READWRITE )
+		{
+			nvsReadWriteOpens++;
+		}
+
+		*out_handle = nvsNextHandle++;
+		nvsNamespaces[*out_handle] = name;
+		return ESP_OK;
+	}
+
+	esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+		const uint8_t* bytes = static_cast<const uint8_t*>(value);
+		nvsBlobs[nvsKey(handle, key)].assign(bytes, bytes + length);
+		nvsWrites++;
+		return ESP_OK;
+	}
+
+	esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+		auto blob = nvsBlobs.find(nvsKey(handle, key));
+
+		if ( blob == nvsBlobs.end() )
+		{
+			return ESP_ERR_NVS_NOT_FOUND;
+		}
+
+		if ( out_value != nullptr )
+		{
+			if ( *length < blob->second.size() )
+			{
+				return ESP_ERR_INVALID_SIZE;
+			}
+			memcpy(out_value, blob->second.data(), blob->second.size());
+		}
+
+		*length = blob->second.size();
+		return ESP_OK;
+	}
+
+	esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+		return nvsBlobs.erase(nvsKey(handle, key)) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+	}
+
+	esp_err_t nvs_commit(nvs_handle_t handle)
+	{
+		(void)handle;
+		return ESP_OK;
+	}
+
+	void nvs_close(nvs_handle_t handle)
+	{
+		std::lock_guard<std::mutex> lock(nvsMutex);
+		nvsNamespaces.erase(handle);
+	}
+
+	BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters,
+									   UBaseType_t priority, TaskHandle_t* createdTask, BaseType_t coreID)
+	{
+		(void)name;
+		(void)priority;
+		(void)coreID;
+
+		taskStackSize = stackDepth;
+		taskCount++;
+
+		if ( createdTask != nullptr )
+		{
+			*createdTask = nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(heldTasksMutex);
+
+		if ( tasksHeld )
+		{
+			heldTasks.emplace_back(function, parameters);
+			return pdPASS;
+		}
+
+		std::thread(function, parameters).detach();
+		return pdPASS;
+	}
+
+	void vTaskDelete(TaskHandle_t task)
+	{
+		// the thread of the task ends when its function returns
+		(void)task;
+	}
+
+	void vTaskDelay(TickType_t ticks)
+	{
+		HostTest::FakeClock::sleep(static_cast<int64_t>(ticks) * portTICK_PERIOD_MS * 1000);
+	}
+}
@@ -0,0 +1,66 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAKEPLATFORM_H
+#define FAKEPLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace HostTest
+{
+    /**
+     * @brief The FakeNVS class stores the blobs of the nvs_* functions, the content survives FakeFlash::reboot().
+     */
+	class FakeNVS
+	{
+		public:
+
+			static void			clear();
+			static uint32_t		writeCount();
+			static uint32_t		readWriteOpenCount();	///< nvs_open calls with NVS_READWRITE, which create the namespace
+	};
+
+    /**
+     * @brief The FakeHeap class sets what heap_caps_get_free_size and heap_caps_get_largest_free_block report.
+     */
+	class FakeHeap
+	{
+		public:
+
+			static void			setFreeSize(size_t freeSize);
+	};
+
+    /**
+     * @brief The FakeTasks class reports the tasks started with xTaskCreatePinnedToCore, they run as threads.
+     */
+	class FakeTasks
+	{
+		public:
+
+			static uint32_t		lastStackSize();
+			static uint32_t		createdTasks();
+
+            /**
+             * @brief           Let tasks created from now on wait until startHeldTasks(), to act before a task runs
+             */
+			static void			holdTasks();
+			static void			startHeldTasks();
+	};
+}
+
+#endif // FAKEPLATFORM_H
@@ -0,0 +1,66 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYWRITER_H
+#define MEMORYWRITER_H
+
+#include "IFirmwareWriter.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace HostTest
+{
+    /**
+     * @brief The MemoryWriter class collects the written firmware in memory, in order or at random offsets.
+     */
+	class MemoryWriter : public IDFix::FOTA::IFirmwareWriter
+	{
+		public:
+
+			esp_err_t writeFirmwareBytes(const void* data, size_t size) override
+			{
+				const uint8_t* bytes = static_cast<const uint8_t*>(data);
+				_data.insert(_data.end(), bytes, bytes + size);
+				_writes++;
+				return ESP_OK;
+			}
+
+			esp_err_t writeFirmwareBytesAt(size_t offset, const void* data, size_t size) override
+			{
+				if ( _data.size() < offset + size )
+				{
+					_data.resize(offset + size);
+				}
+
+				memcpy(&_data[offset], data, size);
+				_writes++;
+				return ESP_OK;
+			}
+
+			const std::vector<uint8_t>&	data() const { return _data; }
+			uint32_t					writes() const { return _writes; }
+
+		private:
+
+			std::vector<uint8_t>		_data;
+			uint32_t					_writes = { 0 };
+	};
+}
+
+#endif // MEMORYWRITER_H
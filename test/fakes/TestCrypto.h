@@ -0,0 +1,119 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TESTCRYPTO_H
+#define TESTCRYPTO_H
+
+#include "HashAlgorithm.h"
+#include "SignatureVerifier.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace HostTest
+{
+    /**
+     * @brief The TestHash class is a 64 bit FNV-1a, enough to notice any changed byte of a test image.
+     */
+	class TestHash : public IDFix::Crypto::HashAlgorithm
+	{
+		public:
+
+			void					begin() override { _hash = OFFSET_BASIS; }
+			void					addData(unsigned char* data, size_t length) override { update(data, length); }
+			void					end() override { memcpy(_digest, &_hash, sizeof(_digest)); }
+			const unsigned char*	getHash() override { return _digest; }
+			size_t					hashLength() override { return sizeof(_digest); }
+
+			void update(const unsigned char* data, size_t length)
+			{
+				for ( size_t i = 0; i < length; i++ )
+				{
+					_hash = (_hash ^ data[i]) * PRIME;
+				}
+			}
+
+			static std::vector<uint8_t> digest(const uint8_t* data, size_t length)
+			{
+				TestHash hash;
+				hash.begin();
+				hash.update(data, length);
+				hash.end();
+				return std::vector<uint8_t>(hash._digest, hash._digest + sizeof(hash._digest));
+			}
+
+		private:
+
+			static const uint64_t	OFFSET_BASIS = 0xcbf29ce484222325ULL;
+			static const uint64_t	PRIME = 0x100000001b3ULL;
+
+			uint64_t				_hash = { OFFSET_BASIS };
+			unsigned char			_digest[8] = { 0 };
+	};
+
+    /**
+     * @brief The TestVerifier class accepts a signature that is the digest XORed with a key.
+     */
+	class TestVerifier : public IDFix::Crypto::SignatureVerifier
+	{
+		public:
+
+			explicit	TestVerifier(uint8_t key) : _key(key) {}
+
+			int verify(const unsigned char* hash, size_t hashLength, const unsigned char* signature, size_t signatureLength) override
+			{
+				_calls++;
+
+				if ( signatureLength != hashLength )
+				{
+					return -1;
+				}
+
+				for ( size_t i = 0; i < hashLength; i++ )
+				{
+					if ( (hash[i] ^ _key) != signature[i] )
+					{
+						return -1;
+					}
+				}
+
+				return 0;
+			}
+
+			static std::vector<uint8_t> sign(const std::vector<uint8_t>& digest, uint8_t key)
+			{
+				std::vector<uint8_t> signature(digest);
+
+				for ( uint8_t& byte : signature )
+				{
+					byte ^= key;
+				}
+
+				return signature;
+			}
+
+			uint32_t	calls() const { return _calls; }
+
+		private:
+
+			uint8_t		_key;
+			uint32_t	_calls = { 0 };
+	};
+}
+
+#endif // TESTCRYPTO_H
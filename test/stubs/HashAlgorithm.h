@@ -0,0 +1,43 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the idfix-crypto header of the same name, only what the component uses. */
+#ifndef HOST_HASHALGORITHM_H
+#define HOST_HASHALGORITHM_H
+
+#include <stddef.h>
+
+namespace IDFix
+{
+	namespace Crypto
+	{
+		class HashAlgorithm
+		{
+			public:
+
+				virtual							~HashAlgorithm() {}
+
+				virtual void					begin() = 0;
+				virtual void					addData(unsigned char* data, size_t length) = 0;
+				virtual void					end() = 0;
+				virtual const unsigned char*	getHash() = 0;
+				virtual size_t					hashLength() = 0;
+		};
+	}
+}
+
+#endif
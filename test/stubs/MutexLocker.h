@@ -0,0 +1,39 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the idfix-core header of the same name, only what the component uses. */
+#ifndef HOST_MUTEXLOCKER_H
+#define HOST_MUTEXLOCKER_H
+
+#include "Mutex.h"
+
+namespace IDFix
+{
+	class MutexLocker
+	{
+		public:
+
+			explicit	MutexLocker(Mutex& mutex) : _mutex(mutex) { _mutex.lock(); }
+						~MutexLocker() { _mutex.unlock(); }
+
+		private:
+
+			Mutex&		_mutex;
+	};
+}
+
+#endif
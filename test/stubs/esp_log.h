@@ -0,0 +1,40 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the ESP-IDF header of the same name, only what the component uses. */
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* prints only if the test raised the level with IDFIX_TEST_LOG_LEVEL (0 = off, 1 = E, 2 = W, 3 = I, 4 = D) */
+void host_log_write(int level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#define ESP_LOGE(tag, format, ...)	host_log_write(1, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)	host_log_write(2, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)	host_log_write(3, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)	host_log_write(4, tag, format, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,35 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the ESP-IDF header of the same name, only what the component uses. */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef unsigned int	UBaseType_t;
+typedef int				BaseType_t;
+typedef uint32_t		TickType_t;
+
+#define pdPASS						1
+#define pdFAIL						0
+#define configTICK_RATE_HZ			100
+#define portTICK_PERIOD_MS			(1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)			((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+#define tskNO_AFFINITY				0x7fffffff
+
+#endif
@@ -0,0 +1,79 @@
+/*   2log.io
+ *   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Affero General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Affero General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the mbedTLS 2.28 header of the same name, only what the component uses. The declarations
+ * match the ABI of libmbedcrypto.so.7 (mbedTLS 2.28), which the host tests link against.
+ */
+#ifndef HOST_MBEDTLS_PK_H
+#define HOST_MBEDTLS_PK_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBEDTLS_PK_SIGNATURE_MAX_SIZE	1024
+
+typedef enum
+{
+	MBEDTLS_MD_NONE = 0,
+	MBEDTLS_MD_MD2,
+	MBEDTLS_MD_MD4,
+	MBEDTLS_MD_MD5,
+	MBEDTLS_MD_SHA1,
+	MBEDTLS_MD_SHA224,
+	MBEDTLS_MD_SHA256,
+	MBEDTLS_MD_SHA384,
+	MBEDTLS_MD_SHA512,
+	MBEDTLS_MD_RIPEMD160
+} mbedtls_md_type_t;
+
+typedef enum
+{
+	MBEDTLS_PK_NONE = 0,
+	MBEDTLS_PK_RSA,
+	MBEDTLS_PK_ECKEY,
+	MBEDTLS_PK_ECKEY_DH,
+	MBEDTLS_PK_ECDSA,
+	MBEDTLS_PK_RSA_ALT,
+	MBEDTLS_PK_RSASSA_PSS,
+	MBEDTLS_PK_OPAQUE
+} mbedtls_pk_type_t;
+
+typedef struct mbedtls_pk_info_t mbedtls_pk_info_t;
+
+typedef struct mbedtls_pk_context
+{
+	const mbedtls_pk_info_t*	pk_info;
+	void*						pk_ctx;
+} mbedtls_pk_context;
+
+void				mbedtls_pk_init(mbedtls_pk_context* ctx);
+void				mbedtls_pk_free(mbedtls_pk_context* ctx);
+int					mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+mbedtls_pk_type_t	mbedtls_pk_get_type(const mbedtls_pk_context* ctx);
+size_t				mbedtls_pk_get_bitlen(const mbedtls_pk_context* ctx);
+int					mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md_alg, const unsigned char* hash, size_t hash_len,
+									  const unsigned char* sig, size_t sig_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
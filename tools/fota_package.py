@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+#   2log.io
+#   Copyright (C) 2021 - 2log.io | mail@2log.io,  sascha@2log.io
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU Affero General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU Affero General Public License for more details.
+#
+#   You should have received a copy of the GNU Affero General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Package and sign firmware images for IDFix::FOTA::FirmwareUpdater.
+
+The packaged image has the layout parsed by FirmwareUpdater::checkFirmware():
+
+    | firmware image | magic bytes | signature | signature length (uint32, little endian) |
+
+The signature is calculated over the firmware image and the magic bytes. The
+upper 8 bits of the signature length carry the signature scheme, 0 selects the
+verifier installed without a scheme on the device. Any number of images can be
+given, they are packaged in parallel. The packages keep the directories of the
+images below their common parent, so build/a/app.bin and build/b/app.bin end up
+as a/app.fota.bin and b/app.fota.bin in the output directory.
+
+Example:
+
+    fota_package.py --key private.pem --magic 2log -o release/ build/*.bin
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
+import zlib
+
+SECTOR_SIZE = 4096
+SCHEME_SHIFT = 24
+
+# scheme name -> (identifier, fixed digest or None)
+SCHEMES = {
+    "default": (0, None),
+    "rsa": (1, None),
+    "ecdsa-p256": (2, "sha256"),
+    "ed25519ph": (3, "sha512"),
+}
+
+# scheme name -> line of "openssl pkey -text" that only the matching key type prints
+KEY_TYPE_MARKERS = {
+    "rsa": "modulus:",
+    "ecdsa-p256": "ASN1 OID: prime256v1",
+    "ed25519ph": "ED25519 Private-Key:",
+}
+
+# Ed25519ph signing was added to openssl pkeyutl in 3.2
+ED25519PH_OPENSSL_VERSION = (3, 2)
+
+
+def openssl_version():
+    """Return the version of the openssl command as (name, (major, minor)), (None, None) if it does not run."""
+    try:
+        result = subprocess.run(["openssl", "version"], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    except OSError:
+        return None, None
+    match = re.match(r"(\S+) (\d+)\.(\d+)", result.stdout.decode(errors="replace"))
+    if result.returncode != 0 or not match:
+        return None, None
+    return match.group(1), (int(match.group(2)), int(match.group(3)))
+
+
+def key_scheme(key):
+    """Return the scheme matching the type of the private key, None for other types."""
+    result = subprocess.run(["openssl", "pkey", "-in", key, "-noout", "-text"], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if result.returncode != 0:
+        raise RuntimeError("openssl failed: " + result.stderr.decode(errors="replace").strip())
+    lines = [line.strip() for line in result.stdout.decode(errors="replace").splitlines()]
+    for scheme, marker in KEY_TYPE_MARKERS.items():
+        if marker in lines:
+            return scheme
+    return None
+
+
+def sign(data, key, digest, scheme):
+    if scheme == "ed25519ph":
+        # main() made sure the openssl command is new enough
+        command = ["openssl", "pkeyutl", "-sign", "-inkey", key, "-rawin", "-pkeyopt", "instance:Ed25519ph"]
+    else:
+        command = ["openssl", "dgst", "-" + digest, "-sign", key]
+
+    result = subprocess.run(command, input=data, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if result.returncode != 0:
+        raise RuntimeError("openssl failed: " + result.stderr.decode(errors="replace").strip())
+    return result.stdout
+
+
+def build_index(package, digest):
+    return {
+        "size": len(package),
+        digest: hashlib.new(digest, package).hexdigest(),
+        "sector_size": SECTOR_SIZE,
+        "sector_crc32": ["%08x" % zlib.crc32(package[offset:offset + SECTOR_SIZE])
+                         for offset in range(0, len(package), SECTOR_SIZE)],
+    }
+
+
+def output_paths(images, output_dir, suffix):
+    """Map each image to its package path, keeping the directories below the common parent of all images."""
+    directories = [os.path.dirname(os.path.abspath(path)) for path in images]
+    common = os.path.commonpath(directories)
+    outputs = {}
+    for path, directory in zip(images, directories):
+        name = os.path.splitext(os.path.basename(path))[0] + suffix
+        outputs[path] = os.path.normpath(os.path.join(output_dir, os.path.relpath(directory, common), name))
+    return outputs
+
+
+def package_image(path, output, args):
+    with open(path, "rb") as image_file:
+        image = image_file.read()
+
+    signed_part = image + args.magic
+    signature = sign(signed_part, args.key, args.digest, args.scheme) if args.key else b""
+    scheme_id = SCHEMES[args.scheme][0] if args.key else 0
+    package = signed_part + signature + struct.pack("<I", len(signature) | (scheme_id << SCHEME_SHIFT))
+
+    os.makedirs(os.path.dirname(output) or ".", exist_ok=True)
+    with open(output, "wb") as package_file:
+        package_file.write(package)
+
+    if args.emit_index:
+        with open(output + ".json", "w") as index_file:
+            json.dump(build_index(package, args.digest), index_file, indent=2)
+
+    return output, len(image), len(signature)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("images", nargs="+", help="firmware images to package")
+    parser.add_argument("-k", "--key", help="PEM private key used with openssl, images are not signed if omitted")
+    parser.add_argument("-m", "--magic", default="", help="magic bytes appended to the image")
+    parser.add_argument("-d", "--digest", default="sha256", help="digest used for the signature (default: sha256)")
+    parser.add_argument("--scheme", choices=sorted(SCHEMES), default="default",
+                        help="signature scheme stored in the image, has to match the key type (default: default)")
+    parser.add_argument("-o", "--output-dir", default=".", help="directory for the packaged images")
+    parser.add_argument("-s", "--suffix", default=".fota.bin", help="file name suffix of the packaged images")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="number of parallel jobs (default: all cores)")
+    parser.add_argument("--emit-index", action="store_true", help="write a JSON index with hash and per sector CRC32 next to each package")
+    args = parser.parse_args()
+
+    args.magic = args.magic.encode()
+    if SCHEMES[args.scheme][1]:
+        args.digest = SCHEMES[args.scheme][1]
+
+    # fail once up front instead of once per image with an unknown option error of openssl
+    if args.key and args.scheme == "ed25519ph":
+        name, version = openssl_version()
+        if name != "OpenSSL" or version < ED25519PH_OPENSSL_VERSION:
+            found = "%s %u.%u" % (name, version[0], version[1]) if version else "no working openssl command"
+            parser.error("--scheme ed25519ph needs OpenSSL %u.%u or newer, found %s" % (ED25519PH_OPENSSL_VERSION + (found,)))
+
+    # a key of another type signs fine, the device only rejects the image at install time
+    if args.key and args.scheme != "default":
+        try:
+            scheme = key_scheme(args.key)
+        except (OSError, RuntimeError) as error:
+            parser.error("cannot read the key type of %s: %s" % (args.key, error))
+        if scheme != args.scheme:
+            parser.error("--scheme %s does not match the key type of %s (%s)" % (args.scheme, args.key, scheme or "no supported scheme"))
+
+    # parallel jobs writing the same package would leave one of them behind silently
+    outputs = output_paths(args.images, args.output_dir, args.suffix)
+    sources = {}
+    for path, output in outputs.items():
+        if output in sources:
+            parser.error("%s and %s would both be packaged to %s" % (sources[output], path, output))
+        sources[output] = path
+
+    failed = 0
+    # the work is done in openssl processes and hashlib, which both release the GIL
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as executor:
+        jobs = {executor.submit(package_image, path, outputs[path], args): path for path in outputs}
+        for job in concurrent.futures.as_completed(jobs):
+            try:
+                output, image_size, signature_size = job.result()
+                print("%s: %u bytes image, %u bytes signature" % (output, image_size, signature_size))
+            except (OSError, RuntimeError) as error:
+                print("%s: %s" % (jobs[job], error), file=sys.stderr)
+                failed += 1
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())